@@ -0,0 +1,440 @@
+#include "dancing_links.hpp"
+#include "sudoku.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace DancingLinks;
+
+namespace {
+
+struct StatsPolicy : DefaultPolicy {
+  static constexpr bool STATS = true;
+};
+
+/**
+ * Exact cover problem as a list of rows. Rows in `deleted` are removed with
+ * DeleteRow after construction, e.g. givens of a Sudoku puzzle.
+ */
+struct Problem {
+  unsigned n_cols = 0, n_secondary = 0;
+  std::vector<std::vector<unsigned>> rows;
+  std::vector<unsigned> deleted;
+
+  template <typename Solver> Solver Build() const {
+    Solver solver(rows.size(), n_cols, n_secondary);
+    for (unsigned r = 0; r < rows.size(); r++) {
+      for (unsigned c : rows[r]) {
+        solver.Add(r, c);
+      }
+    }
+    return solver;
+  }
+
+  // the matrix in compressed sparse rows, see SparseRows.
+  struct Sparse {
+    std::vector<uint8_t> secondary;
+    std::vector<uint64_t> offsets{0};
+    std::vector<uint32_t> columns;
+
+    SparseRows View() const { return {secondary, offsets, columns}; }
+  };
+
+  Sparse ToSparse() const {
+    Sparse ret;
+    ret.secondary.assign(n_cols + n_secondary, 0);
+    std::fill(begin(ret.secondary) + n_cols, end(ret.secondary), 1);
+    for (const auto &row : rows) {
+      ret.columns.insert(end(ret.columns), begin(row), end(row));
+      ret.offsets.push_back(ret.columns.size());
+    }
+    return ret;
+  }
+
+  template <typename Solver> void Delete(Solver &solver) const {
+    for (unsigned r : deleted) {
+      solver.DeleteRow(r);
+    }
+  }
+
+  template <typename Solver> Solver BuildAndDelete() const {
+    auto solver = Build<Solver>();
+    Delete(solver);
+    return solver;
+  }
+};
+
+struct ProblemSet {
+  std::string name;
+  std::vector<Problem> problems;
+  // counting all solutions takes reasonable time.
+  bool count = true;
+};
+
+// Hard 9x9 puzzles with a single solution, among them Arto Inkala's and
+// AI Escargot.
+const char *HARD_9[] = {
+    "8..........36......7..9.2...5...7.......457.....1...3...1....68..85...1..9....4..",
+    "1....7.9..3..2...8..96..5....53..9...1..8...26....4...3......1..4......7..7...3..",
+    "..............3.85..1.2.......5.7.....4...1...9.......5......73..2.1........4...9",
+    ".2.4.37.........32........4.4.2...7.8...5.........1...5.....9...3.9....7..1..86..",
+    "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......",
+    "52...6.........7.13...........4..8..6......5...........418.........3..2...87.....",
+    "6.....8.3.4.7.................5.4.7.3..2.....1.6.......2.....5.....8.6......1....",
+    "48.3............71.2.......7.5....6....2..8.............1.76...3.....4......5....",
+    "....14....3....2...7..........9...3.6.1.............8.2.....1.4....5.6.....7.8...",
+};
+
+// 16x16 puzzles with a single solution, made from random solved grids by
+// removing clues in random order as long as the solution stays unique.
+const char *HARD_16[] = {
+    "|  .  .  6  .  4  .  .  1 11  .  .  .  .  .  . 13 "
+    "| 13  .  9  .  5  7  .  6  .  .  8  .  4  . 16  . "
+    "|  .  7  4  3 14  .  . 13  2  .  .  .  .  .  9 11 "
+    "|  .  .  8  1  .  . 12  .  .  .  .  .  .  6  .  . "
+    "|  1  .  7  .  .  4  .  .  . 12 10 13  .  . 15  9 "
+    "|  .  .  . 11 16 10  .  8  .  .  5  1  .  2  .  . "
+    "|  .  .  .  .  .  . 14  .  .  .  . 16  .  .  .  . "
+    "|  . 16  . 12  .  3  .  .  7  4  2  .  .  .  1 10 "
+    "|  6  . 14  9  .  2  .  .  4  .  .  .  .  .  .  3 "
+    "| 11  .  .  .  .  .  .  3  .  1  .  .  .  .  .  . "
+    "|  .  4  .  . 15  .  .  .  .  .  .  .  7  .  . 12 "
+    "|  .  3  .  7  .  .  .  .  9 11  . 14 15  .  2  . "
+    "|  . 15  .  4  .  .  2  .  .  5  .  . 14 13  6  . "
+    "|  .  .  2  .  8  .  .  .  . 10  .  9  . 12  .  . "
+    "| 14  .  .  .  . 13 15  9  3  .  .  . 10  7  .  . "
+    "|  .  6  . 16  .  .  4  7 15  8  .  .  .  .  .  1 ",
+
+    "|  6  7  .  3 10  .  2  .  .  .  .  . 12  .  .  . "
+    "|  .  9  .  .  .  3  .  6  1  .  .  .  .  4  .  . "
+    "|  . 16  .  2  .  1  .  .  5  .  .  9  .  .  .  . "
+    "|  .  .  .  .  . 13  .  .  .  .  .  . 11  8  . 10 "
+    "| 10  .  . 16  .  .  .  8  6  1  .  .  .  .  7 11 "
+    "|  . 15 11 12  9  .  .  3  . 13  . 14  .  .  . 16 "
+    "|  .  .  7  .  .  . 14  .  .  .  .  .  .  .  .  3 "
+    "|  .  .  .  .  .  2  .  .  .  .  3  .  4  .  9  . "
+    "|  .  .  5 11 12  .  6  4 15  .  1  .  .  .  .  . "
+    "|  . 14  .  .  .  . 10  .  .  7  .  .  6  .  8  . "
+    "|  .  1  .  .  .  .  8  .  .  . 10  .  .  .  .  . "
+    "| 12  8  .  . 15  9  .  .  .  6  4 11 14  3  .  7 "
+    "|  .  .  . 14  .  .  .  . 10 16  .  .  8 12  .  . "
+    "|  . 11 16  7  .  .  . 12  .  9  .  4 15 10  .  5 "
+    "| 15  .  .  .  1  .  .  .  .  .  8 13  2  .  .  . "
+    "|  . 13  4  .  . 15  .  2  . 11  .  .  .  7  3 14 ",
+
+    "|  1  9  .  .  .  .  .  .  .  3  .  . 11  .  .  . "
+    "|  .  8  . 12  .  . 15  .  .  .  .  .  7  9  . 10 "
+    "|  3  .  . 10  . 12  . 11  .  .  . 14  .  4  . 16 "
+    "| 16  .  .  .  9  .  .  .  .  . 12  5  .  3  .  2 "
+    "|  8  .  2  .  . 11  4  7 13  .  .  3  .  .  .  . "
+    "|  .  .  . 15  .  .  8 16  .  1 10  .  .  .  .  4 "
+    "| 13  .  .  .  .  .  1  2  .  .  4  .  .  .  . 12 "
+    "| 11  1  .  6 12  .  .  .  9  .  2  . 10  . 16  8 "
+    "| 12  .  .  .  . 14 13 15 11  .  .  .  6  2  5  . "
+    "| 14  .  .  .  .  . 12  .  .  9  6  . 13  .  .  . "
+    "|  .  .  .  .  .  5  .  .  .  .  .  .  .  .  .  7 "
+    "|  .  .  .  3  .  6  .  .  4  8  . 15  . 12  . 11 "
+    "|  .  .  .  .  .  .  .  8  2  7 16  .  .  .  .  3 "
+    "|  .  .  3  . 13  4  5  .  .  .  .  .  .  .  .  . "
+    "|  .  .  8  .  3 16  .  6 10  . 15  4  .  . 11 13 "
+    "|  5  .  .  7  .  .  9  .  .  .  .  .  .  1  4 15 ",
+
+    "|  .  9  .  3  .  .  .  7  .  .  .  6 16  .  .  2 "
+    "|  .  1 16  .  .  4  .  2  .  .  .  .  3  .  .  7 "
+    "|  .  .  .  5  .  .  .  . 16 11 12  2  1 10  .  . "
+    "|  .  .  .  .  .  .  . 14  .  .  9  .  .  . 12  4 "
+    "| 13  .  .  9  .  8  6  . 12  7  4  .  .  . 10  1 "
+    "|  .  7  .  . 14 10  . 11  .  .  .  . 12 13  .  . "
+    "|  . 15  .  .  .  .  .  .  .  . 14  .  .  .  .  9 "
+    "|  .  .  .  6  .  .  . 15  .  2  .  .  4  .  .  . "
+    "|  .  .  3  . 11  .  . 16  .  .  .  .  .  .  2 12 "
+    "|  . 14  .  .  1  .  .  .  .  .  2 16  6  .  9  . "
+    "|  .  .  4  .  .  .  .  .  8 14  .  . 15  . 13  . "
+    "|  .  . 10  2  5  7 13  .  3  .  .  .  .  .  4 14 "
+    "| 15  .  8  .  .  .  .  . 10  5  . 12  .  .  .  . "
+    "|  .  .  7  .  .  .  . 10  .  8  .  9  .  .  .  5 "
+    "|  3  .  .  .  4 11  .  . 14  . 13  .  .  .  .  . "
+    "|  .  .  .  .  2  6  .  5 11  .  .  3 10 16 15  . "
+};
+
+// No solution, but it takes a search to find out
+// (http://www.jibble.org/impossible-sudoku/).
+const char *IMPOSSIBLE_9 =
+    ".7. ..6 ... 9.. ... .41 ..8 ..9 .5. .9. ..7 ..2 ..3 ... 8.. 4.. 8.. .1. "
+    ".8. 3.. 9.. 16. ... ..7 ... 5.. .8.";
+
+// Sudoku as exact cover: row (r, c, n) covers the cell, the number in the
+// row, in the column and in the box.
+Problem Sudoku(const std::string &puzzle) {
+  auto board = sudoku::SudokuBoard::FromString(puzzle);
+  unsigned side = board.GetSide(), box = std::sqrt(side);
+
+  Problem p;
+  p.n_cols = 4 * side * side;
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      unsigned b = (r / box) * box + c / box;
+      for (unsigned n = 0; n < side; n++) {
+        p.rows.push_back({r * side + c, side * side + r * side + n,
+                          2 * side * side + c * side + n,
+                          3 * side * side + b * side + n});
+      }
+      if (board.Get(r, c) >= 0) {
+        p.deleted.push_back((r * side + c) * side + board.Get(r, c));
+      }
+    }
+  }
+  return p;
+}
+
+// N queens: ranks and files are primary, diagonals secondary.
+Problem Queens(unsigned n) {
+  Problem p;
+  p.n_cols = 2 * n;
+  p.n_secondary = 2 * (2 * n - 1);
+  for (unsigned r = 0; r < n; r++) {
+    for (unsigned c = 0; c < n; c++) {
+      p.rows.push_back({r, n + c, 2 * n + r + c, 4 * n - 1 + (n - 1 - r + c)});
+    }
+  }
+  return p;
+}
+
+using Shape = std::vector<std::pair<int, int>>;
+
+// all rotations and reflections of the shape, moved to the corner.
+std::vector<Shape> Orientations(Shape shape) {
+  std::vector<Shape> ret;
+  for (int i = 0; i < 8; i++) {
+    if (i == 4) {
+      for (auto &[r, c] : shape) {
+        std::swap(r, c);
+      }
+    }
+    for (auto &[r, c] : shape) {
+      std::tie(r, c) = std::pair(c, -r);
+    }
+    int min_r = INT_MAX, min_c = INT_MAX;
+    for (auto [r, c] : shape) {
+      min_r = std::min(min_r, r);
+      min_c = std::min(min_c, c);
+    }
+    Shape moved;
+    for (auto [r, c] : shape) {
+      moved.emplace_back(r - min_r, c - min_c);
+    }
+    std::sort(begin(moved), end(moved));
+    if (std::find(begin(ret), end(ret), moved) == end(ret)) {
+      ret.push_back(moved);
+    }
+  }
+  return ret;
+}
+
+// The 12 pentominoes tiling a height x (60 / height) rectangle: a column for
+// every piece and every cell.
+Problem Pentominoes(unsigned height) {
+  static const std::array<Shape, 12> PIECES = {{
+      {{0, 1}, {0, 2}, {1, 0}, {1, 1}, {2, 1}}, // F
+      {{0, 0}, {0, 1}, {0, 2}, {0, 3}, {0, 4}}, // I
+      {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {3, 1}}, // L
+      {{0, 1}, {1, 1}, {2, 0}, {2, 1}, {3, 0}}, // N
+      {{0, 0}, {0, 1}, {1, 0}, {1, 1}, {2, 0}}, // P
+      {{0, 0}, {0, 1}, {0, 2}, {1, 1}, {2, 1}}, // T
+      {{0, 0}, {0, 2}, {1, 0}, {1, 1}, {1, 2}}, // U
+      {{0, 0}, {1, 0}, {2, 0}, {2, 1}, {2, 2}}, // V
+      {{0, 0}, {1, 0}, {1, 1}, {2, 1}, {2, 2}}, // W
+      {{0, 1}, {1, 0}, {1, 1}, {1, 2}, {2, 1}}, // X
+      {{0, 1}, {1, 0}, {1, 1}, {2, 1}, {3, 1}}, // Y
+      {{0, 0}, {0, 1}, {1, 1}, {2, 1}, {2, 2}}, // Z
+  }};
+  int width = 60 / height;
+
+  Problem p;
+  p.n_cols = 12 + 60;
+  for (unsigned piece = 0; piece < PIECES.size(); piece++) {
+    for (const Shape &shape : Orientations(PIECES[piece])) {
+      for (int r0 = 0; r0 < (int)height; r0++) {
+        for (int c0 = 0; c0 < width; c0++) {
+          std::vector<unsigned> row = {piece};
+          for (auto [r, c] : shape) {
+            if (r0 + r < (int)height && c0 + c < width) {
+              row.push_back(12 + (r0 + r) * width + c0 + c);
+            }
+          }
+          if (row.size() == shape.size() + 1) {
+            p.rows.push_back(row);
+          }
+        }
+      }
+    }
+  }
+  return p;
+}
+
+std::vector<ProblemSet> &Sets() {
+  static std::vector<ProblemSet> sets;
+  if (!sets.empty()) {
+    return sets;
+  }
+
+  ProblemSet hard9{"Sudoku/Hard9x9", {}};
+  for (const char *puzzle : HARD_9) {
+    hard9.problems.push_back(Sudoku(puzzle));
+  }
+  ProblemSet hard16{"Sudoku/Hard16x16", {}};
+  for (const char *puzzle : HARD_16) {
+    hard16.problems.push_back(Sudoku(puzzle));
+  }
+  sets.push_back(hard9);
+  sets.push_back(hard16);
+  sets.push_back({"Sudoku/Impossible9x9", {Sudoku(IMPOSSIBLE_9)}});
+
+  for (unsigned n : {8, 12}) {
+    sets.push_back({"Queens/" + std::to_string(n), {Queens(n)}});
+  }
+  sets.push_back({"Queens/32", {Queens(32)}, false});
+
+  for (unsigned height : {3, 4, 5, 6}) {
+    sets.push_back({"Pentominoes/" + std::to_string(height) + "x" +
+                        std::to_string(60 / height),
+                    {Pentominoes(height)},
+                    height <= 4});
+  }
+  return sets;
+}
+
+// Search tree nodes of Solve (count == false) or Count of every problem.
+uint64_t Nodes(const ProblemSet &set, bool count) {
+  uint64_t ret = 0;
+  for (const Problem &p : set.problems) {
+    auto solver = p.BuildAndDelete<BasicDLSolver<StatsPolicy>>();
+    if (count) {
+      solver.Count();
+    } else {
+      solver.Solve();
+    }
+    ret += solver.Stats().TotalNodes();
+  }
+  return ret;
+}
+
+void SetRate(benchmark::State &state, const char *name, uint64_t per_iteration) {
+  state.counters[name] = benchmark::Counter(
+      (double)per_iteration * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void Construct(benchmark::State &state, const ProblemSet *set) {
+  for (auto _ : state) {
+    for (const Problem &p : set->problems) {
+      auto solver = p.Build<DLSolver>();
+      benchmark::DoNotOptimize(solver);
+    }
+  }
+  SetRate(state, "problems/s", set->problems.size());
+}
+
+// Same matrices as Construct, built in bulk from compressed sparse rows.
+void ConstructSparse(benchmark::State &state, const ProblemSet *set) {
+  std::vector<Problem::Sparse> sparse;
+  for (const Problem &p : set->problems) {
+    sparse.push_back(p.ToSparse());
+  }
+
+  for (auto _ : state) {
+    for (const auto &m : sparse) {
+      DLSolver solver(m.View());
+      benchmark::DoNotOptimize(solver);
+    }
+  }
+  SetRate(state, "problems/s", set->problems.size());
+}
+
+// Only DeleteRow is timed, fresh copies of the matrices are made outside.
+void DeleteRow(benchmark::State &state, const ProblemSet *set) {
+  std::vector<DLSolver> built;
+  for (const Problem &p : set->problems) {
+    built.push_back(p.Build<DLSolver>());
+  }
+
+  for (auto _ : state) {
+    auto copies = built;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < copies.size(); i++) {
+      set->problems[i].Delete(copies[i]);
+    }
+    auto end = std::chrono::steady_clock::now();
+    state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+  }
+  SetRate(state, "problems/s", set->problems.size());
+}
+
+void SolveFirst(benchmark::State &state, const ProblemSet *set) {
+  std::vector<DLSolver> solvers;
+  for (const Problem &p : set->problems) {
+    solvers.push_back(p.BuildAndDelete<DLSolver>());
+  }
+
+  uint64_t solved = 0;
+  for (auto _ : state) {
+    solved = 0;
+    for (auto &solver : solvers) {
+      solved += !solver.Solve().empty();
+    }
+  }
+  SetRate(state, "solutions/s", solved);
+  SetRate(state, "nodes/s", Nodes(*set, false));
+}
+
+void CountAll(benchmark::State &state, const ProblemSet *set) {
+  std::vector<DLSolver> solvers;
+  for (const Problem &p : set->problems) {
+    solvers.push_back(p.BuildAndDelete<DLSolver>());
+  }
+
+  uint64_t found = 0;
+  for (auto _ : state) {
+    found = 0;
+    for (auto &solver : solvers) {
+      found += solver.Count();
+    }
+  }
+  state.counters["solutions"] = (double)found;
+  SetRate(state, "solutions/s", found);
+  SetRate(state, "nodes/s", Nodes(*set, true));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+
+  for (const ProblemSet &set : Sets()) {
+    benchmark::RegisterBenchmark(("Construct/" + set.name).c_str(), Construct,
+                                 &set);
+    benchmark::RegisterBenchmark(("ConstructSparse/" + set.name).c_str(),
+                                 ConstructSparse, &set);
+    if (!set.problems[0].deleted.empty()) {
+      benchmark::RegisterBenchmark(("DeleteRow/" + set.name).c_str(),
+                                   DeleteRow, &set)
+          ->UseManualTime();
+    }
+    benchmark::RegisterBenchmark(("SolveFirst/" + set.name).c_str(),
+                                 SolveFirst, &set);
+    if (set.count) {
+      benchmark::RegisterBenchmark(("CountAll/" + set.name).c_str(), CountAll,
+                                   &set);
+    }
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
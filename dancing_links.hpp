@@ -25,12 +25,39 @@ SOFTWARE.
 #ifndef DANCING_LINKS_HPP_
 #define DANCING_LINKS_HPP_
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <span>
+#include <stop_token>
+#include <thread>
 #include <vector>
+#include <version>
 
 #include <memory_resource>
 
+#if defined(__cpp_lib_generator)
+#include <generator>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace DancingLinks {
 
 namespace Internal {
@@ -133,17 +160,22 @@ private:
   Iter(Element *cur, Element *end) : cur(cur), end(end) {}
 };
 
-class DLSolver final {
+/**
+ * Reference implementation of the Algorithm X matrix build from individually
+ * allocated, pointer linked Elements. DLSolver offers the same interface on a
+ * compact, index based storage and should be preferred.
+ */
+class LinkedDLSolver final {
 public:
-  DLSolver(const DLSolver &) = delete;
-  DLSolver &operator=(const DLSolver &) = delete;
+  LinkedDLSolver(const LinkedDLSolver &) = delete;
+  LinkedDLSolver &operator=(const LinkedDLSolver &) = delete;
 
   /***
    * Instance of the solver.
    * @param n_rows upper limit of the number of provided rows
    * @param n_cols number of columns
    */
-  DLSolver(unsigned n_rows, unsigned n_cols)
+  LinkedDLSolver(unsigned n_rows, unsigned n_cols)
       : n_rows(n_rows), n_cols(n_cols), rows(n_rows), cols(n_cols),
         el_alloc(&memory_resource), header_alloc(&memory_resource) {
     solution.assign(n_rows, 0);
@@ -303,9 +335,2303 @@ protected:
   }
 };
 
+#if defined(__cpp_lib_generator)
+template <typename T> using Generator = std::generator<T>;
+#else
+/**
+ * Minimal replacement of std::generator for standard libraries missing it.
+ * Lazily produces values yielded by the coroutine, as an input range.
+ */
+template <typename T> class Generator {
+public:
+  struct promise_type {
+    T value;
+    std::exception_ptr exception;
+
+    Generator get_return_object() {
+      return Generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(T v) noexcept {
+      value = std::move(v);
+      return {};
+    }
+    void return_void() noexcept {}
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  class iterator {
+  public:
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    explicit iterator(std::coroutine_handle<promise_type> coro) : coro(coro) {}
+
+    const T &operator*() const { return coro.promise().value; }
+
+    iterator &operator++() {
+      Resume(coro);
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+
+    bool operator==(std::default_sentinel_t) const {
+      return !coro || coro.done();
+    }
+
+  private:
+    std::coroutine_handle<promise_type> coro;
+  };
+
+  Generator(Generator &&other) noexcept : coro(other.coro) {
+    other.coro = nullptr;
+  }
+  Generator &operator=(Generator &&other) noexcept {
+    std::swap(coro, other.coro);
+    return *this;
+  }
+  Generator(const Generator &) = delete;
+  Generator &operator=(const Generator &) = delete;
+
+  ~Generator() {
+    if (coro)
+      coro.destroy();
+  }
+
+  iterator begin() {
+    Resume(coro);
+    return iterator{coro};
+  }
+
+  std::default_sentinel_t end() const { return std::default_sentinel; }
+
+private:
+  std::coroutine_handle<promise_type> coro;
+
+  explicit Generator(std::coroutine_handle<promise_type> coro) : coro(coro) {}
+
+  static void Resume(std::coroutine_handle<promise_type> coro) {
+    coro.resume();
+    if (coro.done() && coro.promise().exception) {
+      std::rethrow_exception(coro.promise().exception);
+    }
+  }
+};
+#endif
+
+/**
+ * Node of the compact matrix, laid out as in Knuth's DLX1. Nodes 1..N are
+ * column headers, for which `top` holds the number of rows in the column.
+ * Nodes of one row are stored next to each other and rows are separated by
+ * spacers (`top` <= 0), so left and right neighbours come from the position.
+ * A spacer links up to the first node of the row before it and down to the
+ * last node of the row after it, and stores -(rowId + 1) of the row before it.
+ */
+struct Node {
+  int32_t top;
+  uint32_t up, down;
+};
+
+/**
+ * Horizontal links of the lists of active column headers. Item 0 is the root
+ * of primary columns, item N + 1 the root of secondary ones, item i is the
+ * header of column i - 1.
+ */
+struct Item {
+  uint32_t prev, next;
+};
+
+/**
+ * Per worker deques of task ids. A worker takes tasks from the back of its own
+ * deque and, once it is empty, steals from the front of the others.
+ */
+class TaskQueues final {
+public:
+  TaskQueues(unsigned n_workers) : n_workers(n_workers) {
+    queues = std::make_unique<Queue[]>(n_workers);
+  }
+
+  void Push(unsigned worker, unsigned task) {
+    std::lock_guard<std::mutex> lock(queues[worker].mutex);
+    queues[worker].tasks.push_back(task);
+  }
+
+  bool Pop(unsigned worker, unsigned &task) {
+    for (unsigned i = 0; i < n_workers; i++) {
+      Queue &q = queues[(worker + i) % n_workers];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (q.tasks.empty()) {
+        continue;
+      }
+      if (i == 0) {
+        task = q.tasks.back();
+        q.tasks.pop_back();
+      } else {
+        task = q.tasks.front();
+        q.tasks.pop_front();
+      }
+      return true;
+    }
+    return false;
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<unsigned> tasks;
+  };
+
+  unsigned n_workers;
+  std::unique_ptr<Queue[]> queues;
+};
+
+/**
+ * Limits of a single search. Default constructed means no limit.
+ */
+struct SearchLimits {
+  // search tree nodes entered before giving up, 0 means no limit.
+  uint64_t max_nodes = 0;
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::time_point::max();
+  // cancellation from another thread.
+  std::stop_token stop;
+};
+
+enum class SearchStatus { Solved, NoSolution, Aborted };
+
+struct SolveResult {
+  SearchStatus status;
+  // rows of the solution, empty unless solved.
+  std::vector<int> rows;
+};
+
+struct CountResult {
+  // Solved if a solution was found, Aborted if a limit was reached first.
+  SearchStatus status;
+  // solutions found, a lower bound when aborted.
+  uint64_t count;
+};
+
+/**
+ * Checks the search against SearchLimits once per node. The clock and the
+ * stop token are read at the first node and then every CHECK_INTERVAL nodes.
+ */
+class SearchBudget final {
+public:
+  void Start(const SearchLimits *limits) {
+    this->limits = limits;
+    nodes = 0;
+  }
+
+  void Stop() { limits = nullptr; }
+
+  // nodes counted since Start, including the one that exceeded max_nodes.
+  uint64_t Nodes() const { return nodes; }
+
+  // count one more node, true once a limit is reached.
+  bool Exhausted() {
+    if (!limits) {
+      return false;
+    }
+    nodes++;
+    if (limits->max_nodes != 0 && nodes > limits->max_nodes) {
+      return true;
+    }
+    if ((nodes - 1) % CHECK_INTERVAL != 0) {
+      return false;
+    }
+    return limits->stop.stop_requested() ||
+           std::chrono::steady_clock::now() >= limits->deadline;
+  }
+
+private:
+  static constexpr uint64_t CHECK_INTERVAL = 1024;
+
+  const SearchLimits *limits = nullptr;
+  uint64_t nodes = 0;
+};
+
+/**
+ * Matrix in the node layout of BasicDLSolver, built at compile time. A
+ * constexpr instance is stored in read-only data and a solver created from it
+ * copies the arrays instead of linking every node with Add.
+ * @tparam N_ROWS upper limit of the number of rows
+ * @tparam N_COLS number of primary columns
+ * @tparam N_SECONDARY number of secondary columns
+ * @tparam N_ONES number of ones in the matrix
+ */
+template <size_t N_ROWS, size_t N_COLS, size_t N_SECONDARY, size_t N_ONES>
+class StaticMatrix final {
+public:
+  // headers, the first spacer, the ones and a spacer after every row.
+  static constexpr size_t MAX_NODES = N_COLS + N_SECONDARY + 2 + N_ONES + N_ROWS;
+
+  constexpr StaticMatrix() {
+    constexpr uint32_t n_items = N_COLS + N_SECONDARY;
+    for (uint32_t i = 0; i <= n_items + 1; i++) {
+      items[i] = Item{i, i};
+      nodes[i] = Node{0, i, i};
+    }
+    Link(0, 1, N_COLS);
+    Link(n_items + 1, N_COLS + 1, n_items);
+    nodes[0] = Node{0, 0, 0};
+    nodes[n_items + 1] = Node{0, 0, 0};
+    n_nodes = n_items + 2;
+  }
+
+  /**
+   * Same as BasicDLSolver::Add, but all ones of a row have to be added
+   * together, before any one of the next row.
+   */
+  constexpr void Add(unsigned rowId, unsigned colId) {
+    // fails the constant evaluation of a matrix built at compile time.
+    assert(rowId < N_ROWS && colId < N_COLS + N_SECONDARY);
+    assert(rowId == open_row || rows[rowId] == 0);
+    assert(n_nodes + (rowId != open_row) + 1 <= MAX_NODES);
+    if (rowId != open_row) {
+      open_row = rowId;
+      spacer_before = n_nodes - 1;
+      rows[rowId] = n_nodes;
+      nodes[n_nodes++] = Node{-(int32_t)rowId - 1, rows[rowId], 0};
+    }
+
+    uint32_t me = n_nodes - 1;
+    uint32_t head = colId + 1;
+    nodes[me] = Node{(int32_t)head, head, nodes[head].down};
+    nodes[nodes[head].down].up = me;
+    nodes[head].down = me;
+    nodes[head].top++;
+
+    nodes[n_nodes++] = Node{-(int32_t)rowId - 1, rows[rowId], 0};
+    nodes[spacer_before].down = me;
+  }
+
+  std::array<uint32_t, N_ROWS> rows{};
+  std::array<Item, N_COLS + N_SECONDARY + 2> items{};
+  std::array<Node, MAX_NODES> nodes{};
+  uint32_t n_nodes = 0;
+
+private:
+  static constexpr unsigned NO_ROW = ~0u;
+
+  unsigned open_row = NO_ROW;
+  uint32_t spacer_before = 0;
+
+  constexpr void Link(uint32_t root, uint32_t first, uint32_t last) {
+    uint32_t prev = root;
+    for (uint32_t i = first; i <= last; i++) {
+      items[prev].next = i;
+      items[i].prev = prev;
+      prev = i;
+    }
+    items[prev].next = root;
+    items[root].prev = prev;
+  }
+};
+
+/**
+ * View of a matrix in compressed sparse rows: the ones of row r are in
+ * columns[offsets[r]] .. columns[offsets[r + 1] - 1]. Columns are primary
+ * or secondary in any order, see secondary.
+ */
+struct SparseRows {
+  // one entry per column, non zero for secondary columns.
+  std::span<const uint8_t> secondary;
+  // number of rows + 1 entries, non decreasing, the last one columns.size().
+  std::span<const uint64_t> offsets;
+  std::span<const uint32_t> columns;
+  // color of every one, 0 for none, see BasicDLSolver::Add. Empty if the
+  // matrix has no colors.
+  std::span<const uint32_t> colors = {};
+
+  size_t Rows() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+  size_t Secondary() const {
+    return std::count_if(begin(secondary), end(secondary),
+                         [](uint8_t s) { return s != 0; });
+  }
+};
+
+/**
+ * Compile time options of BasicDLSolver. Derive from it and override the
+ * options to change them.
+ */
+struct DefaultPolicy {
+  /**
+   * Keep primary columns in lists bucketed by their size, so the smallest one
+   * is found without scanning all columns. It costs extra work on every cover
+   * and uncover, so pays off for matrices with many columns.
+   */
+  static constexpr bool BUCKET_COLUMNS = false;
+  /**
+   * Collect SearchStats during the search. Off by default, the counters are
+   * then compiled out.
+   */
+  static constexpr bool STATS = false;
+  /**
+   * Allow colors on secondary columns, see Add(rowId, colId, color). Costs a
+   * color per node and a check on every hide and unhide.
+   */
+  static constexpr bool COLORS = false;
+  /**
+   * Allow bounds on how many rows cover a primary column, see SetBounds.
+   * Searches with Knuth's Algorithm M, which also branches on columns whose
+   * lower bound is met. Not available with BUCKET_COLUMNS nor for parallel
+   * searches.
+   */
+  static constexpr bool MULTIPLICITY = false;
+};
+
+/**
+ * Counters of BasicDLSolver with Policy::STATS. They add up over searches
+ * until ResetStats, parallel searches include work of all workers.
+ */
+struct SearchStats {
+  // rows tried at every depth of the search tree.
+  std::vector<uint64_t> nodes;
+  // how many times a column of every size was chosen for branching.
+  std::vector<uint64_t> branching;
+  // nodes and column headers unlinked or relinked by cover and uncover.
+  uint64_t updates = 0;
+  // memory accesses counted as in Knuth's DLX1: one per node or column
+  // header read or written.
+  uint64_t mems = 0;
+
+  uint64_t TotalNodes() const {
+    uint64_t ret = 0;
+    for (uint64_t n : nodes) {
+      ret += n;
+    }
+    return ret;
+  }
+
+  SearchStats &operator+=(const SearchStats &other) {
+    Add(nodes, other.nodes);
+    Add(branching, other.branching);
+    updates += other.updates;
+    mems += other.mems;
+    return *this;
+  }
+
+  // count one more event at index i of the histogram.
+  static void Bump(std::vector<uint64_t> &histogram, size_t i) {
+    if (i >= histogram.size()) {
+      histogram.resize(i + 1, 0);
+    }
+    histogram[i]++;
+  }
+
+private:
+  static void Add(std::vector<uint64_t> &dst, const std::vector<uint64_t> &src) {
+    if (dst.size() < src.size()) {
+      dst.resize(src.size(), 0);
+    }
+    for (size_t i = 0; i < src.size(); i++) {
+      dst[i] += src[i];
+    }
+  }
+};
+
+template <typename Policy = DefaultPolicy> class BasicDLSolver final {
+public:
+  // Copies share nothing, so every thread can search its own copy.
+  BasicDLSolver(const BasicDLSolver &) = default;
+  BasicDLSolver &operator=(const BasicDLSolver &) = default;
+
+  /***
+   * Instance of the solver.
+   * @param n_rows upper limit of the number of provided rows
+   * @param n_cols number of primary columns, covered exactly once
+   * @param n_secondary number of secondary columns, numbered after the
+   * primary ones. They are covered at most once and never chosen for branching.
+   */
+  BasicDLSolver(unsigned n_rows, unsigned n_cols, unsigned n_secondary = 0)
+      : n_rows(n_rows), n_cols(n_cols), n_secondary(n_secondary),
+        rows(n_rows, 0), items(n_cols + n_secondary + 2),
+        nodes(n_cols + n_secondary + 2), frames(MaxLevels(n_rows, n_cols)) {
+    solution.assign(n_rows, 0);
+
+    LinkItems(0, 1, n_cols);
+    LinkItems(SecondaryRoot(), n_cols + 1, n_cols + n_secondary);
+
+    nodes[0] = Node{0, 0, 0};
+    for (uint32_t i = 1; i <= n_cols + n_secondary; i++) {
+      nodes[i] = Node{0, i, i};
+    }
+    // first spacer, there is no row before it.
+    nodes[n_cols + n_secondary + 1] = Node{0, 0, 0};
+    if constexpr (Policy::COLORS) {
+      colors.assign(nodes.size(), 0);
+    }
+    if constexpr (Policy::MULTIPLICITY) {
+      need.assign(n_cols + 1, 1);
+      room.assign(n_cols + 1, 1);
+      marks.assign(frames.size(), 0);
+    }
+  }
+
+  /**
+   * Instance with the matrix given in compressed sparse rows, e.g. mapped
+   * from a file. Node arrays are allocated once and filled in one pass, the
+   * result is the same as adding the ones row by row with Add. Primary
+   * columns are renumbered to come first and secondary ones after them,
+   * both keeping their order; row ids are unchanged.
+   */
+  explicit BasicDLSolver(const SparseRows &matrix)
+      : BasicDLSolver((unsigned)matrix.Rows(),
+                      (unsigned)(matrix.secondary.size() - matrix.Secondary()),
+                      (unsigned)matrix.Secondary()) {
+    assert(matrix.offsets.empty() ||
+           matrix.offsets.back() == matrix.columns.size());
+    // header of every column of the matrix.
+    std::vector<uint32_t> head(matrix.secondary.size());
+    uint32_t primary = 1, secondary = n_cols + 1;
+    for (size_t c = 0; c < head.size(); c++) {
+      head[c] = matrix.secondary[c] ? secondary++ : primary++;
+    }
+
+    size_t n_nonempty = 0;
+    for (size_t r = 0; r < n_rows; r++) {
+      n_nonempty += matrix.offsets[r] != matrix.offsets[r + 1];
+    }
+    uint32_t spacer = (uint32_t)nodes.size() - 1;
+    nodes.resize(nodes.size() + matrix.columns.size() + n_nonempty);
+    assert(nodes.size() <= UINT32_MAX);
+    assert(matrix.colors.empty() || Policy::COLORS);
+    if constexpr (Policy::COLORS) {
+      colors.assign(nodes.size(), 0);
+    }
+
+    uint32_t p = spacer + 1;
+    for (size_t r = 0; r < n_rows; r++) {
+      uint64_t first = matrix.offsets[r], last = matrix.offsets[r + 1];
+      if (first == last) {
+        continue;
+      }
+      rows[r] = p;
+      for (uint64_t k = first; k < last; k++, p++) {
+        assert(matrix.columns[k] < head.size());
+        uint32_t h = head[matrix.columns[k]];
+        nodes[p] = Node{(int32_t)h, h, nodes[h].down};
+        nodes[nodes[h].down].up = p;
+        nodes[h].down = p;
+        nodes[h].top++;
+        if constexpr (Policy::COLORS) {
+          if (!matrix.colors.empty()) {
+            assert(matrix.colors[k] == 0 || h > n_cols);
+            colors[p] = (int32_t)matrix.colors[k];
+          }
+        }
+      }
+      nodes[spacer].down = p - 1;
+      nodes[p] = Node{-(int32_t)r - 1, rows[r], 0};
+      spacer = p++;
+    }
+  }
+
+  /**
+   * Instance with the matrix built at compile time, the same as if its ones
+   * were added with Add.
+   */
+  template <size_t N_ROWS, size_t N_COLS, size_t N_SECONDARY, size_t N_ONES>
+  explicit BasicDLSolver(
+      const StaticMatrix<N_ROWS, N_COLS, N_SECONDARY, N_ONES> &matrix)
+      : n_rows(N_ROWS), n_cols(N_COLS), n_secondary(N_SECONDARY),
+        rows(begin(matrix.rows), end(matrix.rows)),
+        items(begin(matrix.items), end(matrix.items)),
+        nodes(begin(matrix.nodes), begin(matrix.nodes) + matrix.n_nodes),
+        frames(MaxLevels(N_ROWS, N_COLS)) {
+    solution.assign(N_ROWS, 0);
+    if constexpr (Policy::COLORS) {
+      colors.assign(nodes.size(), 0);
+    }
+    if constexpr (Policy::MULTIPLICITY) {
+      need.assign(n_cols + 1, 1);
+      room.assign(n_cols + 1, 1);
+      marks.assign(frames.size(), 0);
+    }
+  }
+
+  /**
+   * add "one" to the Algorithm X matrix
+   * @param rowId row number
+   * @param colId column number
+   */
+  void Add(unsigned rowId, unsigned colId) { AddOne(rowId, colId, 0); }
+
+  /**
+   * add "one" with a color to the Algorithm X matrix (Knuth's Algorithm C).
+   * Rows sharing a secondary column can be in one solution if all of them
+   * give it the same color. Requires Policy::COLORS.
+   * @param rowId row number
+   * @param colId column number, secondary unless color is 0
+   * @param color positive color, 0 means none: the row excludes all others
+   * with that column
+   */
+  void Add(unsigned rowId, unsigned colId, unsigned color) {
+    static_assert(Policy::COLORS, "colors need Policy::COLORS");
+    assert(color == 0 || colId >= n_cols);
+    assert(color <= INT32_MAX);
+    AddOne(rowId, colId, (int32_t)color);
+  }
+
+  /**
+   * Let a primary column be covered by lower to upper rows instead of exactly
+   * one (Knuth's Algorithm M). Requires Policy::MULTIPLICITY. Rows given to
+   * DeleteRow must then fit into the bounds together, a row which doesn't fit
+   * any more is not deleted.
+   * @param colId primary column
+   * @param lower least number of rows of a solution covering the column
+   * @param upper most rows, at least 1 and at least lower
+   */
+  void SetBounds(unsigned colId, unsigned lower, unsigned upper) {
+    static_assert(Policy::MULTIPLICITY, "bounds need Policy::MULTIPLICITY");
+    assert(colId < n_cols && upper >= 1 && lower <= upper);
+    assert(upper <= INT32_MAX);
+    ResetSearch();
+    need[colId + 1] = (int32_t)lower;
+    room[colId + 1] = (int32_t)upper;
+  }
+
+  /**
+   * Delete given row from the Algorithm X matrix. This is useful if you create
+   * generic instance if the problem first, and than adjust it by marking few
+   * positions as impossible. No row may be assumed, Retract them first.
+   * @param row_id id of the row to remove
+   */
+  void DeleteRow(unsigned row_id) {
+    ResetSearch();
+    assert(assumed.empty());
+    Prepare();
+    if constexpr (Policy::MULTIPLICITY) {
+      // Select of a row left out by an earlier one would take the room of
+      // its columns below 0.
+      uint32_t p = rows[row_id];
+      bool fits = Available(p);
+      assert(fits && "rows given to DeleteRow have to fit into the bounds");
+      if (fits) {
+        Select(p);
+      }
+      return;
+    }
+    for (uint32_t p = rows[row_id]; nodes[p].top > 0; p++) {
+      uint32_t c = (uint32_t)nodes[p].top;
+      if constexpr (Policy::COLORS) {
+        if (colors[p] > 0) {
+          Purify(p);
+        }
+        if (colors[p] != 0) {
+          continue;
+        }
+      }
+      if (items[items[c].next].prev == c && items[items[c].prev].next == c) {
+        // delete only if this column was not deleted before
+        Cover(c);
+      }
+    }
+  }
+
+  /**
+   * Take the row into every solution until it is retracted, unlike DeleteRow
+   * this is undone by Retract. Searches run under all assumptions and leave
+   * the assumed rows out of their solutions, like deleted ones. Shuffle,
+   * RestartSolve and PortfolioSolve keep them, DeleteRow needs none.
+   * @param row_id row with at least one primary column
+   * @return false, assuming nothing, if the row conflicts with an assumed or
+   * deleted row
+   */
+  bool Assume(unsigned row_id) {
+    ResetSearch();
+    Prepare();
+    uint32_t p = rows[row_id];
+    assert(p != 0);
+    if (!Available(p)) {
+      return false;
+    }
+    AssumeNode(p);
+    return true;
+  }
+
+  /**
+   * Undo the latest Assume still in effect.
+   */
+  void Retract() {
+    ResetSearch();
+    assert(!assumed.empty());
+    RetractNode(assumed.back());
+    assumed.pop_back();
+  }
+
+  // Rows assumed and not retracted yet.
+  size_t Assumed() const { return assumed.size(); }
+
+  // Slots of the node array: headers, spacers and ones, and the slots left
+  // behind by rows that Add placed again at the end.
+  size_t NodeCount() const { return nodes.size(); }
+
+  /**
+   * Solve this instance.
+   * @return vector containing ids of rows included in the solution. RowId are
+   * consistant with ids provided in  "add" and "delete" methods.
+   */
+  std::vector<int> Solve() {
+    ResetSearch();
+    int ret = Advance() ? StoreSolution() : 0;
+    return std::vector<int>(begin(solution), begin(solution) + ret);
+  }
+
+  /**
+   * Solve this instance, giving up once any of the limits is reached.
+   * @return Aborted if a limit was reached before the search finished
+   */
+  SolveResult Solve(const SearchLimits &limits) {
+    ResetSearch();
+    budget.Start(&limits);
+    bool found = Advance();
+    budget.Stop();
+
+    if (found) {
+      unsigned n = StoreSolution();
+      return {SearchStatus::Solved,
+              std::vector<int>(begin(solution), begin(solution) + n)};
+    }
+    return {aborted ? SearchStatus::Aborted : SearchStatus::NoSolution, {}};
+  }
+
+  /**
+   * Solve with restarts. Every run shuffles the instance with its own seed,
+   * see Shuffle, and gives up after unit_nodes times the next term of the
+   * Luby sequence 1, 1, 2, 1, 1, 2, 4, ... of search nodes. Lucky orders of
+   * heavy tailed instances are found early, while an unlucky one costs a
+   * bounded number of nodes. The same seed gives the same runs. Assumed rows
+   * stay assumed.
+   * @param seed seed of the first run, the next ones use seed + 1, ...
+   * @param unit_nodes nodes of the shortest run, at least 1
+   * @param limits limits of all runs together
+   * @return Aborted only if one of the limits was reached
+   */
+  SolveResult RestartSolve(uint64_t seed, uint64_t unit_nodes,
+                           const SearchLimits &limits = {}) {
+    assert(unit_nodes > 0);
+    uint64_t spent = 0;
+    for (uint64_t run = 1;; run++) {
+      SearchLimits run_limits = limits;
+      run_limits.max_nodes = unit_nodes * Luby(run);
+      if (limits.max_nodes != 0) {
+        if (spent >= limits.max_nodes) {
+          return {SearchStatus::Aborted, {}};
+        }
+        run_limits.max_nodes =
+            std::min(run_limits.max_nodes, limits.max_nodes - spent);
+      }
+
+      Shuffle(seed + run - 1);
+      auto result = Solve(run_limits);
+      spent += std::min(budget.Nodes(), run_limits.max_nodes);
+      if (result.status != SearchStatus::Aborted ||
+          limits.stop.stop_requested() ||
+          std::chrono::steady_clock::now() >= limits.deadline) {
+        return result;
+      }
+    }
+  }
+
+  /**
+   * Count solutions of this instance. Solutions are not stored, so this is
+   * cheaper than enumerating them, e.g. Count(2) == 1 checks uniqueness.
+   * @param limit stop after that many solutions were found, 0 means no limit
+   * @return number of solutions, at most limit
+   */
+  uint64_t Count(uint64_t limit = 0) {
+    ResetSearch();
+    uint64_t found = 0;
+    while ((limit == 0 || found < limit) && Advance()) {
+      found++;
+    }
+    return found;
+  }
+
+  /**
+   * Count solutions like Count(limit), giving up once any of the limits is
+   * reached.
+   */
+  CountResult Count(uint64_t limit, const SearchLimits &limits) {
+    ResetSearch();
+    budget.Start(&limits);
+    uint64_t found = 0;
+    while ((limit == 0 || found < limit) && Advance()) {
+      found++;
+    }
+    budget.Stop();
+
+    if (aborted) {
+      return {SearchStatus::Aborted, found};
+    }
+    return {found > 0 ? SearchStatus::Solved : SearchStatus::NoSolution, found};
+  }
+
+  /**
+   * Lazily enumerate all solutions of this instance. Every solution is a view
+   * of the solver's internal buffer, valid until the next one is requested.
+   * The solver must outlive the generator and should not be used otherwise
+   * while enumerating.
+   * @return ids of rows included in consecutive solutions
+   */
+  Generator<std::span<const int>> Solutions() {
+    ResetSearch();
+    while (Advance()) {
+      unsigned n = StoreSolution();
+      co_yield std::span<const int>(solution.data(), n);
+    }
+  }
+
+  /**
+   * Count solutions on several threads. The top levels of the search tree are
+   * expanded into independent subproblems, searched by workers on their own
+   * copies of the matrix.
+   * @param n_threads number of workers, 0 means hardware concurrency
+   * @param limit stop after that many solutions were found, 0 means no limit
+   * @return number of solutions, at most limit
+   */
+  uint64_t ParallelCount(unsigned n_threads, uint64_t limit = 0) {
+    n_threads = Workers(n_threads);
+
+    // separate cache lines, workers update them on every solution.
+    struct alignas(64) Counter {
+      uint64_t value = 0;
+    };
+    std::vector<Counter> counts(n_threads);
+    std::atomic<uint64_t> total{0};
+
+    RunParallel(n_threads, [&](BasicDLSolver &, unsigned worker) {
+      counts[worker].value++;
+      return limit == 0 || total.fetch_add(1, std::memory_order_relaxed) + 1 <
+                               limit;
+    });
+
+    uint64_t found = 0;
+    for (auto &c : counts) {
+      found += c.value;
+    }
+    return limit == 0 ? found : std::min(found, limit);
+  }
+
+  /**
+   * Enumerate all solutions on several threads, see ParallelCount.
+   * @param n_threads number of workers, 0 means hardware concurrency
+   * @param callback called as callback(worker, rows) for every solution. Calls
+   * from different workers are concurrent, rows is valid only during the call.
+   */
+  template <typename Callback>
+  void ParallelSolutions(unsigned n_threads, Callback &&callback) {
+    RunParallel(n_threads, [&](BasicDLSolver &local, unsigned worker) {
+      unsigned n = local.StoreSolution();
+      callback(worker, std::span<const int>(local.solution.data(), n));
+      return true;
+    });
+  }
+
+  /**
+   * Solve the instance on several threads racing each other. Worker 0 keeps
+   * the original order, others search a copy shuffled with their own seed.
+   * The first worker to finish stops the others. This cuts the heavy tail of
+   * solve times caused by unlucky choices early in the search. All workers
+   * search under the assumptions of the instance.
+   * @param n_threads number of workers, 0 means hardware concurrency
+   * @param seed base seed of the shuffled copies
+   * @return same as Solve, the solution found first
+   */
+  std::vector<int> PortfolioSolve(unsigned n_threads, uint64_t seed = 0) {
+    n_threads = Workers(n_threads);
+    ResetSearch();
+    Prepare();
+
+    std::atomic<bool> stop{false};
+    std::mutex result_mutex;
+    std::vector<int> result;
+
+    auto work = [&](unsigned worker) {
+      BasicDLSolver local(*this);
+      local.stop_flag = &stop;
+      local.ResetStats();
+      if (worker != 0) {
+        local.Shuffle(seed + worker);
+      }
+
+      bool solved = local.Advance();
+      std::lock_guard<std::mutex> lock(result_mutex);
+      if constexpr (Policy::STATS) {
+        stats += local.stats;
+      }
+      if (local.aborted || stop.exchange(true)) {
+        return;
+      }
+      // first to finish, also when it proved there is no solution.
+      if (solved) {
+        unsigned n = local.StoreSolution();
+        result.assign(begin(local.solution), begin(local.solution) + n);
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < n_threads; i++) {
+      workers.emplace_back(work, i);
+    }
+    work(0);
+    for (auto &t : workers) {
+      t.join();
+    }
+    return result;
+  }
+
+  /**
+   * Counters of the searches so far. Always empty unless Policy::STATS is set.
+   */
+  const SearchStats &Stats() const { return stats; }
+  void ResetStats() { stats = SearchStats(); }
+
+  /**
+   * Pseudo-randomly reorder the columns and the rows within every column.
+   * Changes which of equally small columns is chosen and the order rows are
+   * tried in, but not the set of solutions. Assumptions stay in effect.
+   * @param seed same seed gives the same order
+   */
+  void Shuffle(uint64_t seed) {
+    ResetSearch();
+    // hidden rows are relinked by their old neighbours, so the assumptions
+    // are retracted around the shuffle and taken again.
+    std::vector<uint32_t> kept = assumed;
+    while (!assumed.empty()) {
+      RetractNode(assumed.back());
+      assumed.pop_back();
+    }
+    LayOut();
+    std::mt19937_64 rng(seed);
+    std::vector<uint32_t> order;
+
+    for (uint32_t c = items[0].next; c != 0; c = items[c].next) {
+      order.push_back(c);
+    }
+    std::shuffle(begin(order), end(order), rng);
+    Relink(0, order, [this](uint32_t i) -> uint32_t & { return items[i].prev; },
+           [this](uint32_t i) -> uint32_t & { return items[i].next; });
+    buckets_valid = false;
+
+    std::vector<uint32_t> column;
+    for (uint32_t c : order) {
+      column.clear();
+      for (uint32_t p = nodes[c].down; p != c; p = nodes[p].down) {
+        column.push_back(p);
+      }
+      std::shuffle(begin(column), end(column), rng);
+      Relink(c, column, [this](uint32_t i) -> uint32_t & { return nodes[i].up; },
+             [this](uint32_t i) -> uint32_t & { return nodes[i].down; });
+    }
+
+    PrepareBuckets();
+    for (uint32_t p : kept) {
+      AssumeNode(p);
+    }
+  }
+
+protected:
+  static constexpr unsigned NO_ROW = ~0u;
+  static constexpr unsigned NO_DEPTH_LIMIT = UINT_MAX;
+  // subproblems created per worker, more of them balance the load better.
+  static constexpr unsigned TASKS_PER_WORKER = 32;
+  static constexpr unsigned MAX_SPLIT_DEPTH = 16;
+
+  // Search level: column chosen for branching and the row currently tried.
+  struct Frame {
+    uint32_t header;
+    uint32_t row;
+  };
+
+  size_t n_rows, n_cols, n_secondary;
+
+  // index of the first node of every row, 0 if the row is empty.
+  std::vector<uint32_t> rows;
+  std::vector<Item> items;
+  std::vector<Node> nodes;
+  // color of every node with Policy::COLORS, -1 while its column is purified
+  // to that color.
+  std::vector<int32_t> colors;
+
+  // With Policy::MULTIPLICITY, for every primary column header: rows still
+  // needed to reach the lower bound, negative once it is exceeded, and rows
+  // it can still take.
+  std::vector<int32_t> need, room;
+  // Rows removed from the column of their level after their branch was
+  // searched, and the size of that stack when every level was entered.
+  std::vector<uint32_t> tweaks, marks;
+  // first node of every row given to Assume, in order.
+  std::vector<uint32_t> assumed;
+
+  std::vector<int> solution;
+
+  // What Advance does when called: start a new search, enter a new level or
+  // backtrack from a reported solution.
+  enum class State : uint8_t { Idle, Enter, Backtrack };
+
+  // explicit search stack, every level covers at least one column, or with
+  // Policy::MULTIPLICITY chooses a row or closes a column.
+  std::vector<Frame> frames;
+  unsigned level = 0;
+  State state = State::Idle;
+  // set when Advance returned because of stop_flag or the budget.
+  bool aborted = false;
+  const std::atomic<bool> *stop_flag = nullptr;
+  SearchBudget budget;
+  // levels below base_level are fixed by EnterSubproblem.
+  unsigned base_level = 0;
+  // Advance reports nodes at that level as if they were solutions.
+  unsigned depth_limit = NO_DEPTH_LIMIT;
+
+  // Doubly linked lists of active primary columns, one per column size.
+  // Entry i is column header i, entry n_cols + 1 + k the head of bucket k.
+  std::vector<Item> buckets;
+  // no bucket below that one holds a column.
+  uint32_t min_bucket = 0;
+  bool buckets_valid = false;
+
+  // row currently appended by Add, and the spacer preceding it.
+  unsigned open_row = NO_ROW;
+  uint32_t spacer_before = 0;
+
+  // One added to a row laid out before, but not as the last one. Such ones
+  // wait in pending, in the order they were added, until LayOut.
+  struct PendingOne {
+    uint32_t row, head;
+    int32_t color;
+  };
+  std::vector<PendingOne> pending;
+
+  SearchStats stats;
+
+  void Mems(uint64_t n) {
+    if constexpr (Policy::STATS) {
+      stats.mems += n;
+    }
+  }
+
+  void Updates(uint64_t n) {
+    if constexpr (Policy::STATS) {
+      stats.updates += n;
+    }
+  }
+
+  void AddOne(unsigned rowId, unsigned colId, int32_t color) {
+    assert(rowId < n_rows && colId < n_cols + n_secondary);
+    ResetSearch();
+    buckets_valid = false;
+    uint32_t head = colId + 1;
+
+    // Moving the row to the end on every such one would copy it over and
+    // over, so they are placed together by LayOut.
+    if (!pending.empty() || (rowId != open_row && rows[rowId] != 0)) {
+      pending.push_back(PendingOne{rowId, head, color});
+      return;
+    }
+    if (rowId != open_row) {
+      OpenRow(rowId);
+    }
+    uint32_t me = AppendNode(head);
+    LinkNode(me, color);
+  }
+
+  void OpenRow(unsigned rowId) {
+    uint32_t old_first = rows[rowId];
+
+    open_row = rowId;
+    spacer_before = (uint32_t)nodes.size() - 1;
+    rows[rowId] = (uint32_t)nodes.size();
+
+    // Row was added before, but not as the last one. Move its nodes to the
+    // end, so they are kept next to each other. Old slots are left unused.
+    for (uint32_t p = old_first; p != 0 && nodes[p].top > 0; p++) {
+      uint32_t me = (uint32_t)nodes.size();
+      Node moved = nodes[p];
+      nodes.push_back(moved);
+      nodes[moved.up].down = me;
+      nodes[moved.down].up = me;
+      nodes[spacer_before].down = me;
+      if constexpr (Policy::COLORS) {
+        colors.push_back(colors[p]);
+      }
+    }
+
+    nodes.push_back(Node{-(int32_t)rowId - 1, rows[rowId], 0});
+    assert(nodes.size() <= UINT32_MAX);
+  }
+
+  // Put a node of column head at the end of the open row, not linked into
+  // the column yet.
+  uint32_t AppendNode(uint32_t head) {
+    // the trailing spacer of the open row is recreated after the new node.
+    nodes.pop_back();
+    uint32_t me = (uint32_t)nodes.size();
+    nodes.push_back(Node{(int32_t)head, 0, 0});
+    nodes.push_back(Node{-(int32_t)open_row - 1, rows[open_row], 0});
+    assert(nodes.size() <= UINT32_MAX);
+    nodes[spacer_before].down = me;
+    if constexpr (Policy::COLORS) {
+      colors.resize(nodes.size(), 0);
+    }
+    return me;
+  }
+
+  // Link node p at the top of its column.
+  void LinkNode(uint32_t p, int32_t color) {
+    uint32_t head = (uint32_t)nodes[p].top;
+    nodes[p].up = head;
+    nodes[p].down = nodes[head].down;
+    nodes[nodes[head].down].up = p;
+    nodes[head].down = p;
+    nodes[head].top++;
+    if constexpr (Policy::COLORS) {
+      colors[p] = color;
+    }
+  }
+
+  // Place the pending ones: every row they belong to moves to the end once,
+  // then they are linked into their columns in the order they were added,
+  // as if every one was placed by its Add.
+  void LayOut() {
+    if (pending.empty()) {
+      return;
+    }
+    std::vector<uint32_t> order(pending.size());
+    std::iota(begin(order), end(order), 0u);
+    std::stable_sort(begin(order), end(order), [this](uint32_t a, uint32_t b) {
+      return pending[a].row < pending[b].row;
+    });
+
+    std::vector<uint32_t> placed(pending.size());
+    for (uint32_t i : order) {
+      if (pending[i].row != open_row) {
+        OpenRow(pending[i].row);
+      }
+      placed[i] = AppendNode(pending[i].head);
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+      LinkNode(placed[i], pending[i].color);
+    }
+    pending.clear();
+  }
+
+  // Lay out pending ones and buckets before searching or changing the matrix.
+  void Prepare() {
+    LayOut();
+    PrepareBuckets();
+  }
+
+  uint32_t SecondaryRoot() const { return n_cols + n_secondary + 1; }
+
+  static size_t MaxLevels(size_t n_rows, size_t n_cols) {
+    // every chosen row, and a closed column, takes a level.
+    return Policy::MULTIPLICITY ? n_rows + n_cols + 1 : n_cols + 1;
+  }
+
+  // i-th term, counting from 1, of the Luby sequence 1, 1, 2, 1, 1, 2, 4, ...
+  static uint64_t Luby(uint64_t i) {
+    for (;;) {
+      int k = std::bit_width(i);
+      if (i == (1ull << k) - 1) {
+        return 1ull << (k - 1);
+      }
+      i -= (1ull << (k - 1)) - 1;
+    }
+  }
+
+  // circular list of items first..last, starting at root.
+  void LinkItems(uint32_t root, uint32_t first, uint32_t last) {
+    uint32_t prev = root;
+    for (uint32_t i = first; i <= last; i++) {
+      items[prev].next = i;
+      items[i].prev = prev;
+      prev = i;
+    }
+    items[prev].next = root;
+    items[root].prev = prev;
+  }
+
+  // Make the circular list starting at head consist of elements in order.
+  template <typename Prev, typename Next>
+  static void Relink(uint32_t head, const std::vector<uint32_t> &order,
+                     Prev &&prev, Next &&next) {
+    uint32_t last = head;
+    for (uint32_t i : order) {
+      next(last) = i;
+      prev(i) = last;
+      last = i;
+    }
+    next(last) = head;
+    prev(head) = last;
+  }
+
+  int RowOf(uint32_t p) const {
+    while (nodes[p].top > 0) {
+      p++;
+    }
+    return -nodes[p].top - 1;
+  }
+
+  // remove all other nodes of the row p from their columns.
+  void Hide(uint32_t p) {
+    for (uint32_t q = p + 1; q != p;) {
+      int32_t x = nodes[q].top;
+      Mems(1);
+      if (x <= 0) {
+        q = nodes[q].up;
+        continue;
+      }
+      if constexpr (Policy::COLORS) {
+        // column purified to the color of this node, which is left in it.
+        if (colors[q] < 0) {
+          q++;
+          continue;
+        }
+      }
+      uint32_t u = nodes[q].up, d = nodes[q].down;
+      nodes[u].down = d;
+      nodes[d].up = u;
+      nodes[x].top--;
+      Mems(3);
+      Updates(1);
+      if constexpr (Policy::BUCKET_COLUMNS) {
+        if ((uint32_t)x <= n_cols) {
+          BucketRemove(x);
+          BucketInsert(x);
+        }
+      }
+      q++;
+    }
+  }
+
+  void Unhide(uint32_t p) {
+    for (uint32_t q = p - 1; q != p;) {
+      int32_t x = nodes[q].top;
+      Mems(1);
+      if (x <= 0) {
+        q = nodes[q].down;
+        continue;
+      }
+      if constexpr (Policy::COLORS) {
+        if (colors[q] < 0) {
+          q--;
+          continue;
+        }
+      }
+      uint32_t u = nodes[q].up, d = nodes[q].down;
+      nodes[u].down = q;
+      nodes[d].up = q;
+      nodes[x].top++;
+      Mems(3);
+      Updates(1);
+      if constexpr (Policy::BUCKET_COLUMNS) {
+        if ((uint32_t)x <= n_cols) {
+          BucketRemove(x);
+          BucketInsert(x);
+        }
+      }
+      q--;
+    }
+  }
+
+  void Cover(uint32_t head) {
+    for (uint32_t p = nodes[head].down; p != head; p = nodes[p].down) {
+      Hide(p);
+      Mems(1);
+    }
+
+    uint32_t l = items[head].prev, r = items[head].next;
+    items[l].next = r;
+    items[r].prev = l;
+    Mems(4);
+    Updates(1);
+
+    if constexpr (Policy::BUCKET_COLUMNS) {
+      if (head <= n_cols) {
+        BucketRemove(head);
+      }
+    }
+  }
+
+  void Uncover(uint32_t head) {
+    if constexpr (Policy::BUCKET_COLUMNS) {
+      if (head <= n_cols) {
+        BucketInsert(head);
+      }
+    }
+
+    uint32_t l = items[head].prev, r = items[head].next;
+    items[l].next = head;
+    items[r].prev = head;
+    Mems(4);
+    Updates(1);
+
+    for (uint32_t p = nodes[head].up; p != head; p = nodes[p].up) {
+      Unhide(p);
+      Mems(1);
+    }
+  }
+
+  // Hide rows giving the column of p other color than p, the ones with the
+  // same color stay and are marked, so hiding other rows skips them.
+  void Purify(uint32_t p) {
+    int32_t color = colors[p];
+    uint32_t head = (uint32_t)nodes[p].top;
+    for (uint32_t q = nodes[head].down; q != head; q = nodes[q].down) {
+      Mems(2);
+      if (colors[q] != color) {
+        Hide(q);
+      } else if (q != p) {
+        colors[q] = -1;
+      }
+    }
+  }
+
+  void Unpurify(uint32_t p) {
+    int32_t color = colors[p];
+    uint32_t head = (uint32_t)nodes[p].top;
+    for (uint32_t q = nodes[head].up; q != head; q = nodes[q].up) {
+      Mems(2);
+      if (colors[q] < 0) {
+        colors[q] = color;
+      } else if (q != p) {
+        Unhide(q);
+      }
+    }
+  }
+
+  // Commit the other columns of the chosen row: cover or purify them.
+  void CoverRow(uint32_t row) {
+    for (uint32_t p = row + 1; p != row;) {
+      int32_t x = nodes[p].top;
+      if (x <= 0) {
+        p = nodes[p].up;
+        continue;
+      }
+      if constexpr (Policy::COLORS) {
+        if (colors[p] != 0) {
+          // -1 only if purified to the same color already.
+          if (colors[p] > 0) {
+            Purify(p);
+          }
+          p++;
+          continue;
+        }
+      }
+      Cover((uint32_t)x);
+      p++;
+    }
+  }
+
+  void UncoverRow(uint32_t row) {
+    for (uint32_t p = row - 1; p != row;) {
+      int32_t x = nodes[p].top;
+      if (x <= 0) {
+        p = nodes[p].down;
+        continue;
+      }
+      if constexpr (Policy::COLORS) {
+        if (colors[p] != 0) {
+          if (colors[p] > 0) {
+            Unpurify(p);
+          }
+          p--;
+          continue;
+        }
+      }
+      Uncover((uint32_t)x);
+      p--;
+    }
+  }
+
+  // Take the row of the available node p into every solution.
+  void AssumeNode(uint32_t p) {
+    assert(Available(p));
+    if constexpr (Policy::MULTIPLICITY) {
+      Select(p);
+    } else {
+      CommitFirst(p);
+      CoverRow(p);
+    }
+    assumed.push_back(p);
+  }
+
+  // Undo AssumeNode of p, the latest assumption still in effect.
+  void RetractNode(uint32_t p) {
+    if constexpr (Policy::MULTIPLICITY) {
+      Deselect(p);
+      tweaks.push_back(p);
+      Untweak((uint32_t)tweaks.size() - 1);
+    } else {
+      UncoverRow(p);
+      UncommitFirst(p);
+    }
+  }
+
+  // Whether the row of node p is in all its columns and they are all active.
+  bool Available(uint32_t p) const {
+    for (uint32_t q = p;;) {
+      uint32_t x = (uint32_t)nodes[q].top;
+      if (nodes[nodes[q].up].down != q || items[items[x].prev].next != x) {
+        return false;
+      }
+      q++;
+      if (nodes[q].top <= 0) {
+        q = nodes[q].up;
+      }
+      if (q == p) {
+        return true;
+      }
+    }
+  }
+
+  // Commit the column of p itself, CoverRow does the others.
+  void CommitFirst(uint32_t p) {
+    if constexpr (Policy::COLORS) {
+      if (colors[p] != 0) {
+        if (colors[p] > 0) {
+          Purify(p);
+        }
+        return;
+      }
+    }
+    Cover((uint32_t)nodes[p].top);
+  }
+
+  void UncommitFirst(uint32_t p) {
+    if constexpr (Policy::COLORS) {
+      if (colors[p] != 0) {
+        if (colors[p] > 0) {
+          Unpurify(p);
+        }
+        return;
+      }
+    }
+    Uncover((uint32_t)nodes[p].top);
+  }
+
+  // Take the row of node p into the solution: remove it from its columns
+  // and let it cover them. Columns reaching their upper bound are covered.
+  void Select(uint32_t p) {
+    uint32_t head = (uint32_t)nodes[p].top;
+    uint32_t u = nodes[p].up, d = nodes[p].down;
+    nodes[u].down = d;
+    nodes[d].up = u;
+    nodes[head].top--;
+    Hide(p);
+    Mems(3);
+
+    Commit(p);
+    for (uint32_t q = p + 1; q != p;) {
+      if (nodes[q].top <= 0) {
+        q = nodes[q].up;
+        continue;
+      }
+      Commit(q);
+      q++;
+    }
+  }
+
+  // Undo Select except for removing the row from its columns, the row stays
+  // out as a tweak until its level is left.
+  void Deselect(uint32_t p) {
+    for (uint32_t q = p - 1; q != p;) {
+      if (nodes[q].top <= 0) {
+        q = nodes[q].down;
+        continue;
+      }
+      Uncommit(q);
+      q--;
+    }
+    Uncommit(p);
+  }
+
+  void Commit(uint32_t q) {
+    uint32_t head = (uint32_t)nodes[q].top;
+    if (head <= n_cols) {
+      need[head]--;
+      if (--room[head] == 0) {
+        Cover(head);
+      }
+      return;
+    }
+    if constexpr (Policy::COLORS) {
+      if (colors[q] != 0) {
+        if (colors[q] > 0) {
+          Purify(q);
+        }
+        return;
+      }
+    }
+    Cover(head);
+  }
+
+  void Uncommit(uint32_t q) {
+    uint32_t head = (uint32_t)nodes[q].top;
+    if (head <= n_cols) {
+      if (room[head]++ == 0) {
+        Uncover(head);
+      }
+      need[head]++;
+      return;
+    }
+    if constexpr (Policy::COLORS) {
+      if (colors[q] != 0) {
+        if (colors[q] > 0) {
+          Unpurify(q);
+        }
+        return;
+      }
+    }
+    Uncover(head);
+  }
+
+  // Put back rows removed since the stack of tweaks had mark entries. Each
+  // was first in its column when removed, so it goes back first.
+  void Untweak(uint32_t mark) {
+    while (tweaks.size() > mark) {
+      uint32_t p = tweaks.back();
+      tweaks.pop_back();
+      Unhide(p);
+      uint32_t head = (uint32_t)nodes[p].top;
+      nodes[nodes[p].up].down = p;
+      nodes[nodes[p].down].up = p;
+      nodes[head].top++;
+      Mems(3);
+    }
+  }
+
+  /**
+   * Column of fewest branches: every row of it, and closing it without more
+   * rows once its lower bound is met.
+   * @return 0 if a column can't reach its lower bound
+   */
+  uint32_t GetSlackColumn() {
+    uint32_t ret = 0;
+    int32_t best = INT32_MAX;
+    for (uint32_t c = items[0].next; c != 0; c = items[c].next) {
+      Mems(3);
+      int32_t branches = nodes[c].top + 1 - std::max(need[c], 0);
+      if (branches < best) {
+        ret = c;
+        best = branches;
+        if (branches <= 1) {
+          break;
+        }
+      }
+    }
+    return best <= 0 ? 0 : ret;
+  }
+
+  uint32_t GetSmallColumn() {
+    if constexpr (Policy::BUCKET_COLUMNS) {
+      while (buckets[n_cols + 1 + min_bucket].next == n_cols + 1 + min_bucket) {
+        min_bucket++;
+      }
+      return buckets[n_cols + 1 + min_bucket].next;
+    }
+
+    uint32_t ret = 0;
+    for (uint32_t c = items[0].prev; c != 0; c = items[c].prev) {
+      Mems(2);
+      if (ret == 0 || nodes[c].top < nodes[ret].top) {
+        ret = c;
+        // nothing beats a column with a single row.
+        if (nodes[c].top <= 1) {
+          break;
+        }
+      }
+    }
+
+    return ret;
+  }
+
+  // Put all active primary columns into buckets, after Add changed sizes.
+  void PrepareBuckets() {
+    if (!Policy::BUCKET_COLUMNS || buckets_valid) {
+      return;
+    }
+
+    int32_t max_size = 0;
+    for (uint32_t c = items[0].next; c != 0; c = items[c].next) {
+      max_size = std::max(max_size, nodes[c].top);
+    }
+
+    buckets.assign(n_cols + 1 + max_size + 1, Item{0, 0});
+    for (uint32_t k = n_cols + 1; k < buckets.size(); k++) {
+      buckets[k] = Item{k, k};
+    }
+    min_bucket = 0;
+    // Inserted at the bucket head, so the reverse order keeps the choice
+    // among equal columns the same as the scan in GetSmallColumn.
+    for (uint32_t c = items[0].next; c != 0; c = items[c].next) {
+      BucketInsert(c);
+    }
+    buckets_valid = true;
+  }
+
+  void BucketInsert(uint32_t c) {
+    uint32_t k = (uint32_t)nodes[c].top;
+    uint32_t head = n_cols + 1 + k;
+    uint32_t next = buckets[head].next;
+    buckets[c] = Item{head, next};
+    buckets[next].prev = c;
+    buckets[head].next = c;
+    min_bucket = std::min(min_bucket, k);
+  }
+
+  void BucketRemove(uint32_t c) {
+    uint32_t prev = buckets[c].prev, next = buckets[c].next;
+    buckets[prev].next = next;
+    buckets[next].prev = prev;
+  }
+
+  /**
+   * Advance the search to the next solution, starting a new search if none is
+   * in progress. The search state lives in `frames` rather than on the call
+   * stack, so it stays suspended at the found solution until resumed.
+   * @return true if a solution was found; its rows are in frames[0..level).
+   * false if the tree is exhausted, the matrix is then fully restored, or if
+   * the search was stopped by stop_flag or the budget, then `aborted` is set
+   * and the search stays suspended.
+   */
+  bool Advance() {
+    if constexpr (Policy::MULTIPLICITY) {
+      return AdvanceMultiple();
+    }
+    if (state == State::Idle) {
+      Prepare();
+    }
+    bool forward = state != State::Backtrack;
+    aborted = false;
+
+    for (;;) {
+      if (forward) {
+        if ((stop_flag && stop_flag->load(std::memory_order_relaxed)) ||
+            budget.Exhausted()) {
+          state = State::Enter;
+          aborted = true;
+          return false;
+        }
+
+        if (items[0].next == 0 || level == depth_limit) {
+          state = State::Backtrack;
+          return true;
+        }
+
+        uint32_t header = GetSmallColumn();
+        if constexpr (Policy::STATS) {
+          SearchStats::Bump(stats.branching, nodes[header].top);
+        }
+        if (nodes[header].down == header) {
+          forward = false;
+          continue;
+        }
+
+        Cover(header);
+        frames[level] = Frame{header, nodes[header].down};
+      } else {
+        if (level == base_level) {
+          state = State::Idle;
+          return false;
+        }
+
+        level--;
+        UncoverRow(frames[level].row);
+        frames[level].row = nodes[frames[level].row].down;
+      }
+
+      Frame &frame = frames[level];
+      if (frame.row == frame.header) {
+        Uncover(frame.header);
+        forward = false;
+        continue;
+      }
+
+      if constexpr (Policy::STATS) {
+        SearchStats::Bump(stats.nodes, level);
+      }
+      CoverRow(frame.row);
+      level++;
+      forward = true;
+    }
+  }
+
+  /**
+   * Advance with Policy::MULTIPLICITY. A level branching on a column tries
+   * its rows from the first one, removing every row already tried from the
+   * column (a tweak), so each set of rows is found once. After the rows, if
+   * the lower bound is met, it closes the column without more rows. A frame
+   * of a closed column has the header as its row.
+   */
+  bool AdvanceMultiple() {
+    static_assert(!Policy::BUCKET_COLUMNS,
+                  "bounds are not supported with BUCKET_COLUMNS");
+    if (state == State::Idle) {
+      LayOut();
+    }
+    bool forward = state != State::Backtrack;
+    aborted = false;
+
+    for (;;) {
+      if (forward) {
+        if ((stop_flag && stop_flag->load(std::memory_order_relaxed)) ||
+            budget.Exhausted()) {
+          state = State::Enter;
+          aborted = true;
+          return false;
+        }
+
+        if (items[0].next == 0 || level == depth_limit) {
+          state = State::Backtrack;
+          return true;
+        }
+
+        uint32_t header = GetSlackColumn();
+        if (header == 0) {
+          forward = false;
+          continue;
+        }
+        if constexpr (Policy::STATS) {
+          SearchStats::Bump(stats.branching, nodes[header].top);
+        }
+        frames[level] = Frame{header, header};
+        marks[level] = (uint32_t)tweaks.size();
+      } else {
+        if (level == base_level) {
+          state = State::Idle;
+          return false;
+        }
+
+        level--;
+        Frame &frame = frames[level];
+        if (frame.row == frame.header) {
+          Uncover(frame.header);
+          Untweak(marks[level]);
+          forward = false;
+          continue;
+        }
+        Deselect(frame.row);
+        tweaks.push_back(frame.row);
+      }
+
+      Frame &frame = frames[level];
+      uint32_t c = frame.header;
+      if (nodes[c].top > 0 && nodes[c].top >= need[c]) {
+        frame.row = nodes[c].down;
+        Select(frame.row);
+      } else if (need[c] <= 0) {
+        // all rows were tried, the column gets no more.
+        frame.row = c;
+        Cover(c);
+      } else {
+        Untweak(marks[level]);
+        forward = false;
+        continue;
+      }
+
+      if constexpr (Policy::STATS) {
+        SearchStats::Bump(stats.nodes, level);
+      }
+      level++;
+      forward = true;
+    }
+  }
+
+  // Abandon the search in progress and restore the matrix.
+  void ResetSearch() {
+    while (level > base_level) {
+      level--;
+      if constexpr (Policy::MULTIPLICITY) {
+        Frame &frame = frames[level];
+        if (frame.row == frame.header) {
+          Uncover(frame.header);
+        } else {
+          Deselect(frame.row);
+          tweaks.push_back(frame.row);
+        }
+        Untweak(marks[level]);
+        continue;
+      }
+      UncoverRow(frames[level].row);
+      Uncover(frames[level].header);
+    }
+    state = State::Idle;
+    aborted = false;
+  }
+
+  // Fix the first levels of the search to the given choices. Split counted
+  // them in the stats already, so replaying and undoing them doesn't count.
+  void EnterSubproblem(std::span<const Frame> prefix) {
+    uint64_t updates = stats.updates, mems = stats.mems;
+    PrepareBuckets();
+    for (const Frame &frame : prefix) {
+      Cover(frame.header);
+      CoverRow(frame.row);
+      frames[level++] = frame;
+    }
+    base_level = level;
+    stats.updates = updates;
+    stats.mems = mems;
+  }
+
+  void LeaveSubproblem() {
+    ResetSearch();
+    uint64_t updates = stats.updates, mems = stats.mems;
+    base_level = 0;
+    ResetSearch();
+    stats.updates = updates;
+    stats.mems = mems;
+  }
+
+  // Expand the search tree until there are enough subproblems for workers.
+  // Only the last pass counts in the stats, workers count the levels below
+  // it.
+  std::vector<std::vector<Frame>> Split(unsigned n_workers) {
+    std::vector<std::vector<Frame>> tasks;
+    SearchStats before = stats;
+    for (depth_limit = 1; depth_limit <= MAX_SPLIT_DEPTH; depth_limit++) {
+      tasks.clear();
+      stats = before;
+      ResetSearch();
+      bool deeper = false;
+      while (Advance()) {
+        tasks.emplace_back(begin(frames), begin(frames) + level);
+        deeper = deeper || level == depth_limit;
+      }
+      if (!deeper || tasks.size() >= TASKS_PER_WORKER * n_workers) {
+        break;
+      }
+    }
+    depth_limit = NO_DEPTH_LIMIT;
+    return tasks;
+  }
+
+  /**
+   * Search all subproblems on worker threads. on_solution(local, worker) is
+   * called with the worker's copy suspended at a solution, and returns false
+   * to stop all workers.
+   */
+  static unsigned Workers(unsigned n_threads) {
+    return n_threads != 0 ? n_threads
+                          : std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  template <typename OnSolution>
+  void RunParallel(unsigned n_threads, OnSolution &&on_solution) {
+    static_assert(!Policy::MULTIPLICITY,
+                  "parallel search is not supported with bounds");
+    n_threads = Workers(n_threads);
+
+    ResetSearch();
+    auto tasks = Split(n_threads);
+
+    TaskQueues queues(n_threads);
+    for (unsigned i = 0; i < tasks.size(); i++) {
+      queues.Push(i % n_threads, i);
+    }
+
+    std::atomic<bool> stop{false};
+    std::mutex stats_mutex;
+    auto work = [&](unsigned worker) {
+      BasicDLSolver local(*this);
+      local.stop_flag = &stop;
+      local.ResetStats();
+      unsigned task;
+      while (!stop.load(std::memory_order_relaxed) &&
+             queues.Pop(worker, task)) {
+        local.EnterSubproblem(tasks[task]);
+        while (!stop.load(std::memory_order_relaxed) && local.Advance()) {
+          if (!on_solution(local, worker)) {
+            stop = true;
+          }
+        }
+        local.LeaveSubproblem();
+      }
+      if constexpr (Policy::STATS) {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats += local.stats;
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < n_threads; i++) {
+      workers.emplace_back(work, i);
+    }
+    work(0);
+    for (auto &t : workers) {
+      t.join();
+    }
+  }
+
+  unsigned StoreSolution() {
+    unsigned n = 0;
+    for (unsigned i = 0; i < level; i++) {
+      // levels closing a column choose no row.
+      if (frames[i].row != frames[i].header) {
+        solution[n++] = RowOf(frames[i].row);
+      }
+    }
+    return n;
+  }
+};
+
+using DLSolver = BasicDLSolver<>;
+
+/**
+ * Operations on bitsets stored as arrays of 64-bit words. Lengths are
+ * multiples of BitOps::WORDS, so the vector loops need no tail handling.
+ */
+struct BitOps {
+  static constexpr unsigned WORDS = 4;
+
+  static size_t Words(size_t bits) {
+    size_t words = (bits + 63) / 64;
+    return (words + WORDS - 1) / WORDS * WORDS;
+  }
+
+  // dst = a & ~b
+  static void AndNot(uint64_t *dst, const uint64_t *a, const uint64_t *b,
+                     size_t n) {
+#if defined(__AVX2__)
+    for (size_t i = 0; i < n; i += 4) {
+      __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+      __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+      _mm256_storeu_si256((__m256i *)(dst + i), _mm256_andnot_si256(vb, va));
+    }
+#elif defined(__SSE2__)
+    for (size_t i = 0; i < n; i += 2) {
+      __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+      __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_andnot_si128(vb, va));
+    }
+#else
+    for (size_t i = 0; i < n; i++) {
+      dst[i] = a[i] & ~b[i];
+    }
+#endif
+  }
+
+  // dst = a & b
+  static void And(uint64_t *dst, const uint64_t *a, const uint64_t *b,
+                  size_t n) {
+#if defined(__AVX2__)
+    for (size_t i = 0; i < n; i += 4) {
+      __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+      __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+      _mm256_storeu_si256((__m256i *)(dst + i), _mm256_and_si256(va, vb));
+    }
+#elif defined(__SSE2__)
+    for (size_t i = 0; i < n; i += 2) {
+      __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+      __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_and_si128(va, vb));
+    }
+#else
+    for (size_t i = 0; i < n; i++) {
+      dst[i] = a[i] & b[i];
+    }
+#endif
+  }
+
+  static void Set(uint64_t *bits, size_t i) { bits[i / 64] |= 1ull << (i % 64); }
+
+  static bool Get(const uint64_t *bits, size_t i) {
+    return (bits[i / 64] >> (i % 64)) & 1;
+  }
+
+  static bool Any(const uint64_t *bits, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      if (bits[i]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Remove the lowest set bit and return its index, or -1 if none is set.
+  static long PopLowest(uint64_t *bits, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      if (bits[i]) {
+        unsigned b = std::countr_zero(bits[i]);
+        bits[i] &= bits[i] - 1;
+        return (long)(i * 64 + b);
+      }
+    }
+    return -1;
+  }
+};
+
+/**
+ * Exact cover solver keeping the matrix as bitsets: every row is a mask of its
+ * columns and every column a mask of its rows, search state is a mask of rows
+ * still available and of columns still uncovered. Each choice is a few word
+ * operations instead of chasing links, which pays off for small matrices
+ * (e.g. 9x9 Sudoku). Interface is the same as of DLSolver.
+ */
+class BitsetSolver final {
+public:
+  /***
+   * Instance of the solver.
+   * @param n_rows upper limit of the number of provided rows
+   * @param n_cols number of primary columns, covered exactly once
+   * @param n_secondary number of secondary columns, numbered after the
+   * primary ones. They are covered at most once and never chosen for branching.
+   */
+  BitsetSolver(unsigned n_rows, unsigned n_cols, unsigned n_secondary = 0)
+      : n_rows(n_rows), n_cols(n_cols), n_secondary(n_secondary),
+        row_words(BitOps::Words(n_rows)),
+        col_words(BitOps::Words(n_cols + n_secondary)),
+        matrix(std::make_shared<Matrix>()), deleted(col_words, 0) {
+    matrix->row_masks.assign(n_rows * col_words, 0);
+    matrix->col_masks.assign((n_cols + n_secondary) * row_words, 0);
+    solution.assign(n_rows, 0);
+  }
+
+  /**
+   * add "one" to the Algorithm X matrix
+   * @param rowId row number
+   * @param colId column number
+   */
+  void Add(unsigned rowId, unsigned colId) {
+    assert(rowId < n_rows && colId < n_cols + n_secondary);
+    // copies share the matrix until one of them changes it.
+    if (matrix.use_count() > 1) {
+      matrix = std::make_shared<Matrix>(*matrix);
+    }
+    BitOps::Set(RowMask(rowId), colId);
+    BitOps::Set(ColMask(colId), rowId);
+    matrix->prepared = false;
+  }
+
+  /**
+   * Delete given row from the Algorithm X matrix, as in DLSolver: columns of
+   * the row count as covered and all rows using them are removed.
+   * @param row_id id of the row to remove
+   */
+  void DeleteRow(unsigned row_id) {
+    for (size_t i = 0; i < col_words; i++) {
+      deleted[i] |= RowMask(row_id)[i];
+    }
+  }
+
+  /**
+   * Solve this instance.
+   * @return vector containing ids of rows included in the solution. RowId are
+   * consistant with ids provided in  "add" and "delete" methods.
+   */
+  std::vector<int> Solve() {
+    Start();
+    int ret = Advance() ? level : 0;
+    return std::vector<int>(begin(solution), begin(solution) + ret);
+  }
+
+  /**
+   * Solve this instance, giving up once any of the limits is reached.
+   * @return Aborted if a limit was reached before the search finished
+   */
+  SolveResult Solve(const SearchLimits &limits) {
+    Start();
+    budget.Start(&limits);
+    bool found = Advance();
+    budget.Stop();
+
+    if (found) {
+      return {SearchStatus::Solved,
+              std::vector<int>(begin(solution), begin(solution) + level)};
+    }
+    return {aborted ? SearchStatus::Aborted : SearchStatus::NoSolution, {}};
+  }
+
+  /**
+   * Precompute the structures used by the search. Done by Solve and Count
+   * when needed; call it on a matrix that is going to be copied, so copies
+   * share the result instead of repeating it.
+   */
+  void Prepare() {
+    if (matrix.use_count() > 1) {
+      matrix = std::make_shared<Matrix>(*matrix);
+    }
+    auto &conflicts = matrix->conflicts;
+    auto &row_start = matrix->row_start;
+    auto &row_cols = matrix->row_cols;
+    auto &present = matrix->present;
+
+    conflicts.assign(n_rows * row_words, 0);
+    for (size_t r = 0; r < n_rows; r++) {
+      for (size_t i = 0; i < col_words; i++) {
+        for (uint64_t w = RowMask(r)[i]; w; w &= w - 1) {
+          const uint64_t *col = ColMask(i * 64 + std::countr_zero(w));
+          for (size_t j = 0; j < row_words; j++) {
+            Conflicts(r)[j] |= col[j];
+          }
+        }
+      }
+    }
+
+    row_start.assign(1, 0);
+    row_cols.clear();
+    for (size_t r = 0; r < n_rows; r++) {
+      for (size_t c = 0; c < n_cols; c++) {
+        if (BitOps::Get(RowMask(r), c)) {
+          row_cols.push_back(c);
+        }
+      }
+      row_start.push_back(row_cols.size());
+    }
+
+    present.assign(row_words, 0);
+    for (size_t r = 0; r < n_rows; r++) {
+      if (row_start[r + 1] != row_start[r]) {
+        BitOps::Set(present.data(), r);
+      }
+    }
+
+    matrix->prepared = true;
+  }
+
+  /**
+   * Count solutions of this instance, see DLSolver::Count.
+   * @param limit stop after that many solutions were found, 0 means no limit
+   * @return number of solutions, at most limit
+   */
+  uint64_t Count(uint64_t limit = 0) {
+    Start();
+    uint64_t found = 0;
+    while ((limit == 0 || found < limit) && Advance()) {
+      found++;
+    }
+    return found;
+  }
+
+private:
+  size_t n_rows, n_cols, n_secondary;
+  size_t row_words, col_words;
+
+  // Everything not changed by the search, shared by copies of the solver.
+  struct Matrix {
+    std::vector<uint64_t> row_masks;
+    std::vector<uint64_t> col_masks;
+    // Computed by Prepare.
+    // rows sharing a column with the row, the row itself included.
+    std::vector<uint64_t> conflicts;
+    // primary columns of every row, row r has row_cols[row_start[r]..]
+    std::vector<uint32_t> row_start, row_cols;
+    // rows with a primary column.
+    std::vector<uint64_t> present;
+    bool prepared = false;
+  };
+  std::shared_ptr<Matrix> matrix;
+
+  // columns covered by DeleteRow.
+  std::vector<uint64_t> deleted;
+
+  std::vector<int> solution;
+
+  // Explicit search stack. For every level: rows still available, columns
+  // still uncovered and rows of the chosen column not tried yet.
+  std::vector<uint64_t> active, uncovered, candidates;
+  // levels the stack has room for.
+  size_t levels = 0;
+  // number of available rows in every primary column at the current level.
+  std::vector<uint32_t> sizes;
+  unsigned level = 0;
+  bool backtrack = false;
+  // set when Advance returned because of the budget.
+  bool aborted = false;
+  SearchBudget budget;
+
+  // Pointer arithmetic rather than indexing, as the vectors are empty for a
+  // matrix without rows or columns.
+  uint64_t *RowMask(size_t r) {
+    return matrix->row_masks.data() + r * col_words;
+  }
+  uint64_t *ColMask(size_t c) {
+    return matrix->col_masks.data() + c * row_words;
+  }
+  uint64_t *Conflicts(size_t r) {
+    return matrix->conflicts.data() + r * row_words;
+  }
+  uint64_t *Active(size_t l) { return active.data() + l * row_words; }
+  uint64_t *Uncovered(size_t l) { return uncovered.data() + l * col_words; }
+  uint64_t *Candidates(size_t l) { return candidates.data() + l * row_words; }
+
+  void Start() {
+    if (!matrix->prepared) {
+      Prepare();
+    }
+    const auto &row_start = matrix->row_start;
+    const auto &row_cols = matrix->row_cols;
+
+    // the stack grows with the search depth, see Reserve.
+    Reserve(16);
+    sizes.resize(n_cols);
+
+    uint64_t *rows0 = Active(0);
+    std::copy(begin(matrix->present), end(matrix->present), rows0);
+    for (size_t i = 0; i < col_words; i++) {
+      for (uint64_t w = deleted[i]; w; w &= w - 1) {
+        BitOps::AndNot(rows0, rows0, ColMask(i * 64 + std::countr_zero(w)),
+                       row_words);
+      }
+    }
+
+    uint32_t *sizes0 = sizes.data();
+    std::fill(sizes0, sizes0 + n_cols, 0);
+    for (size_t i = 0; i < row_words; i++) {
+      for (uint64_t w = rows0[i]; w; w &= w - 1) {
+        size_t r = i * 64 + std::countr_zero(w);
+        for (uint32_t k = row_start[r]; k < row_start[r + 1]; k++) {
+          sizes0[row_cols[k]]++;
+        }
+      }
+    }
+
+    uint64_t *cols0 = Uncovered(0);
+    std::fill(cols0, cols0 + col_words, 0);
+    for (size_t c = 0; c < n_cols; c++) {
+      if (!BitOps::Get(deleted.data(), c)) {
+        BitOps::Set(cols0, c);
+      }
+    }
+
+    level = 0;
+    backtrack = false;
+    aborted = false;
+  }
+
+  // uncovered primary column with the fewest available rows.
+  long GetSmallColumn(unsigned &count) {
+    const uint64_t *cols = Uncovered(level);
+    long ret = -1;
+    count = UINT_MAX;
+
+    for (size_t i = 0; i < col_words; i++) {
+      for (uint64_t w = cols[i]; w; w &= w - 1) {
+        size_t c = i * 64 + std::countr_zero(w);
+        unsigned k = sizes[c];
+        if (k < count) {
+          count = k;
+          ret = (long)c;
+          // nothing beats a column with a single row.
+          if (k <= 1) {
+            return ret;
+          }
+        }
+      }
+    }
+    return ret;
+  }
+
+  // make room for levels 0..n-1 of the search stack.
+  void Reserve(size_t n) {
+    if (levels >= n) {
+      return;
+    }
+    levels = std::max(n, 2 * levels);
+    active.resize(levels * row_words);
+    uncovered.resize(levels * col_words);
+    candidates.resize(levels * row_words);
+  }
+
+  // Next level state after choosing row r: rows sharing a column with r are
+  // no longer available, and sizes of their columns go down.
+  void Choose(size_t r) {
+    Reserve(level + 2);
+    const uint64_t *rows = Active(level);
+    const uint64_t *conflict = Conflicts(r);
+    BitOps::AndNot(Active(level + 1), rows, conflict, row_words);
+    BitOps::AndNot(Uncovered(level + 1), Uncovered(level), RowMask(r),
+                   col_words);
+
+    UpdateSizes(rows, conflict, -1);
+  }
+
+  // Undo Choose of the row chosen at the current level.
+  void Unchoose() {
+    UpdateSizes(Active(level), Conflicts(solution[level]), 1);
+  }
+
+  // add delta to sizes of columns of available rows in the conflict mask.
+  void UpdateSizes(const uint64_t *rows, const uint64_t *conflict, int delta) {
+    const auto &row_start = matrix->row_start;
+    const auto &row_cols = matrix->row_cols;
+    for (size_t i = 0; i < row_words; i++) {
+      for (uint64_t w = rows[i] & conflict[i]; w; w &= w - 1) {
+        size_t removed = i * 64 + std::countr_zero(w);
+        for (uint32_t k = row_start[removed]; k < row_start[removed + 1]; k++) {
+          sizes[row_cols[k]] += delta;
+        }
+      }
+    }
+  }
+
+  /**
+   * Advance the search to the next solution, see DLSolver::Advance.
+   * @return true if a solution was found; its rows are in solution[0..level)
+   */
+  bool Advance() {
+    bool forward = !backtrack;
+
+    for (;;) {
+      if (forward) {
+        if (budget.Exhausted()) {
+          aborted = true;
+          return false;
+        }
+        if (!BitOps::Any(Uncovered(level), col_words)) {
+          backtrack = true;
+          return true;
+        }
+
+        unsigned count;
+        long c = GetSmallColumn(count);
+        if (count == 0) {
+          forward = false;
+          continue;
+        }
+        BitOps::And(Candidates(level), ColMask(c), Active(level), row_words);
+      } else {
+        if (level == 0) {
+          backtrack = false;
+          return false;
+        }
+        level--;
+        Unchoose();
+      }
+
+      long r = BitOps::PopLowest(Candidates(level), row_words);
+      if (r < 0) {
+        forward = false;
+        continue;
+      }
+
+      solution[level] = (int)r;
+      Choose(r);
+      level++;
+      forward = true;
+    }
+  }
+};
+
 } // namespace Internal
 
+using Internal::BasicDLSolver;
+using Internal::BitsetSolver;
+using Internal::DefaultPolicy;
 using Internal::DLSolver;
+using Internal::LinkedDLSolver;
+using Internal::SearchLimits;
+using Internal::SearchStats;
+using Internal::SearchStatus;
+using Internal::SolveResult;
+using Internal::SparseRows;
+using Internal::StaticMatrix;
 } // namespace DancingLinks
 
 #endif
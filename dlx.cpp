@@ -0,0 +1,362 @@
+#include "dancing_links.hpp"
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using namespace DancingLinks;
+
+namespace {
+
+/**
+ * Exact cover problem in the text format of Knuth's DLX programs. The first
+ * line names the items, primary ones before a "|" and secondary ones after
+ * it. A primary item may be given bounds on how many options cover it as
+ * "lower:upper|item", or "count|item" for exactly that many. Every following
+ * line is an option, the names of its items; a secondary item may be given a
+ * color as "item:color". Lines starting with "|" are comments, empty lines
+ * are skipped.
+ */
+struct Problem {
+  // whole input, names and options view it.
+  std::string text;
+  vector<std::string_view> names;
+  // text of every option, for printing solutions.
+  vector<std::string_view> options;
+  vector<uint8_t> secondary;
+  vector<uint64_t> offsets{0};
+  vector<uint32_t> columns;
+  // color of every item of the options, 0 for none; empty without colors.
+  vector<uint32_t> colors;
+  // bounds of every primary item; empty when all are covered exactly once.
+  vector<std::pair<unsigned, unsigned>> bounds;
+
+  SparseRows Rows() const { return {secondary, offsets, columns, colors}; }
+};
+
+struct ColorPolicy : DefaultPolicy {
+  static constexpr bool COLORS = true;
+};
+
+struct BoundsPolicy : DefaultPolicy {
+  static constexpr bool MULTIPLICITY = true;
+};
+
+struct BoundsColorPolicy : BoundsPolicy {
+  static constexpr bool COLORS = true;
+};
+
+std::string ReadAll(std::FILE *in) {
+  std::string ret;
+  char buffer[1 << 16];
+  size_t n;
+  while ((n = std::fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    ret.append(buffer, n);
+  }
+  return ret;
+}
+
+bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Splits text into lines and lines into names, in place.
+class Scanner final {
+public:
+  explicit Scanner(std::string_view text) : text(text) {}
+
+  // next line which is not empty nor a comment.
+  bool NextLine(std::string_view &line) {
+    while (pos < text.size()) {
+      size_t end = text.find('\n', pos);
+      if (end == std::string_view::npos) {
+        end = text.size();
+      }
+      line = text.substr(pos, end - pos);
+      pos = end + 1;
+      line_no++;
+
+      size_t first = 0;
+      while (first < line.size() && IsSpace(line[first])) {
+        first++;
+      }
+      line.remove_prefix(first);
+      while (!line.empty() && IsSpace(line.back())) {
+        line.remove_suffix(1);
+      }
+      if (!line.empty() && line[0] != '|') {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static bool NextName(std::string_view &line, std::string_view &name) {
+    size_t first = 0;
+    while (first < line.size() && IsSpace(line[first])) {
+      first++;
+    }
+    size_t last = first;
+    while (last < line.size() && !IsSpace(line[last])) {
+      last++;
+    }
+    name = line.substr(first, last - first);
+    line.remove_prefix(last);
+    return !name.empty();
+  }
+
+  unsigned LineNo() const { return line_no; }
+
+private:
+  std::string_view text;
+  size_t pos = 0;
+  unsigned line_no = 0;
+};
+
+std::optional<unsigned> ParseNumber(std::string_view text) {
+  unsigned ret = 0;
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), ret);
+  if (ec != std::errc() || end != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return ret;
+}
+
+// "lower:upper" or "count", upper has to be positive and at least lower.
+std::optional<std::pair<unsigned, unsigned>> ParseBounds(std::string_view text) {
+  size_t colon = text.find(':');
+  auto lower = ParseNumber(text.substr(0, colon));
+  auto upper = colon == std::string_view::npos
+                   ? lower
+                   : ParseNumber(text.substr(colon + 1));
+  if (!lower || !upper || *upper == 0 || *lower > *upper ||
+      *upper > INT32_MAX) {
+    return std::nullopt;
+  }
+  return std::pair{*lower, *upper};
+}
+
+std::optional<Problem> Parse(std::string text) {
+  Problem p;
+  p.text = std::move(text);
+  Scanner scanner(p.text);
+
+  auto error = [&](const std::string &message) {
+    cerr << "line " << scanner.LineNo() << ": " << message << endl;
+    return std::nullopt;
+  };
+
+  std::string_view line, name;
+  if (!scanner.NextLine(line)) {
+    return error("no items");
+  }
+  std::unordered_map<std::string_view, uint32_t> ids;
+  vector<std::pair<unsigned, unsigned>> bounds;
+  bool secondary = false, bounded = false;
+  while (Scanner::NextName(line, name)) {
+    if (name == "|") {
+      if (secondary) {
+        return error("second \"|\" in the items");
+      }
+      secondary = true;
+      continue;
+    }
+    std::pair<unsigned, unsigned> bound{1, 1};
+    size_t bar = name.find('|');
+    if (bar != std::string_view::npos) {
+      if (secondary) {
+        return error("bounds of secondary item " + std::string(name));
+      }
+      auto parsed = ParseBounds(name.substr(0, bar));
+      if (!parsed) {
+        return error("bad bounds of item " + std::string(name));
+      }
+      bound = *parsed;
+      bounded = true;
+      name = name.substr(bar + 1);
+    }
+    if (!ids.emplace(name, (uint32_t)p.names.size()).second) {
+      return error("item " + std::string(name) + " given twice");
+    }
+    p.names.push_back(name);
+    p.secondary.push_back(secondary);
+    if (!secondary) {
+      bounds.push_back(bound);
+    }
+  }
+  if (bounded) {
+    p.bounds = std::move(bounds);
+  }
+
+  // position of every item in the current option, to find repeated ones.
+  vector<uint64_t> seen(p.names.size(), UINT64_MAX);
+  // colors are numbered from 1 in the order of appearance.
+  std::unordered_map<std::string_view, uint32_t> color_ids;
+  vector<uint32_t> colors;
+  while (scanner.NextLine(line)) {
+    std::string_view option = line;
+    uint64_t row = p.options.size();
+    while (Scanner::NextName(line, name)) {
+      std::string_view color;
+      size_t colon = name.find(':');
+      if (colon != std::string_view::npos) {
+        color = name.substr(colon + 1);
+        name = name.substr(0, colon);
+      }
+      auto it = ids.find(name);
+      if (it == ids.end()) {
+        return error("unknown item " + std::string(name));
+      }
+      if (seen[it->second] == row) {
+        return error("item " + std::string(name) + " repeated in the option");
+      }
+      seen[it->second] = row;
+      p.columns.push_back(it->second);
+
+      uint32_t color_id = 0;
+      if (colon != std::string_view::npos) {
+        if (!p.secondary[it->second]) {
+          return error("color of primary item " + std::string(name));
+        }
+        if (color.empty()) {
+          return error("empty color of item " + std::string(name));
+        }
+        color_id = color_ids.emplace(color, color_ids.size() + 1).first->second;
+      }
+      colors.push_back(color_id);
+    }
+    p.options.push_back(option);
+    p.offsets.push_back(p.columns.size());
+  }
+  if (!color_ids.empty()) {
+    p.colors = std::move(colors);
+  }
+  return p;
+}
+
+struct Options {
+  bool count_only = false;
+  uint64_t limit = 0;
+  unsigned n_threads = 1;
+};
+
+// Solve and write the solutions or their count, returns the number found.
+template <typename Policy>
+uint64_t Run(const Problem &problem, const Options &options) {
+  BasicDLSolver<Policy> solver(problem.Rows());
+  if constexpr (Policy::MULTIPLICITY) {
+    for (unsigned c = 0; c < problem.bounds.size(); c++) {
+      solver.SetBounds(c, problem.bounds[c].first, problem.bounds[c].second);
+    }
+  }
+
+  uint64_t found = 0;
+  if (options.count_only) {
+    // bounded problems are counted on one thread.
+    if constexpr (Policy::MULTIPLICITY) {
+      found = solver.Count(options.limit);
+    } else {
+      found = options.n_threads == 1
+                  ? solver.Count(options.limit)
+                  : solver.ParallelCount(options.n_threads, options.limit);
+    }
+    std::printf("%llu\n", (unsigned long long)found);
+    return found;
+  }
+
+  std::string out;
+  for (auto solution : solver.Solutions()) {
+    for (int row : solution) {
+      out += problem.options[row];
+      out += '\n';
+    }
+    out += '\n';
+    if (out.size() > (1 << 16)) {
+      std::fwrite(out.data(), 1, out.size(), stdout);
+      out.clear();
+    }
+    if (++found == options.limit) {
+      break;
+    }
+  }
+  std::fwrite(out.data(), 1, out.size(), stdout);
+  return found;
+}
+
+void Usage(const char *name) {
+  cerr << "Usage: " << name << " [-c] [-n limit] [-j threads] [file]" << endl;
+  cerr << "Solves an exact cover problem in the text format of Knuth's DLX "
+          "programs, from file or standard input."
+       << endl;
+  cerr << "Solutions are written as their options, one per line, followed "
+          "by an empty line."
+       << endl;
+  cerr << "  -c          only count solutions" << endl;
+  cerr << "  -n limit    stop after that many solutions" << endl;
+  cerr << "  -j threads  count on that many threads, 0 for all cores" << endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  const char *path = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-c") == 0) {
+      options.count_only = true;
+    } else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      options.limit = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      options.n_threads = std::max(0, std::atoi(argv[++i]));
+    } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+      Usage(argv[0]);
+      return 1;
+    } else {
+      path = argv[i];
+    }
+  }
+
+  std::FILE *in = path ? std::fopen(path, "rb") : stdin;
+  if (!in) {
+    cerr << "Can't open " << path << endl;
+    return 1;
+  }
+  auto t_start = steady_clock::now();
+  auto problem = Parse(ReadAll(in));
+  if (path) {
+    std::fclose(in);
+  }
+  if (!problem) {
+    return 1;
+  }
+  auto t_read = steady_clock::now();
+
+  // colors cost a check on every hide and bounds a slower search, only
+  // problems with them pay it.
+  bool colors = !problem->colors.empty(), bounds = !problem->bounds.empty();
+  uint64_t found = bounds ? (colors ? Run<BoundsColorPolicy>(*problem, options)
+                                    : Run<BoundsPolicy>(*problem, options))
+                          : (colors ? Run<ColorPolicy>(*problem, options)
+                                    : Run<DefaultPolicy>(*problem, options));
+  std::fflush(stdout);
+  auto t_end = steady_clock::now();
+
+  cerr << problem->names.size() << " items, " << problem->options.size()
+       << " options, read in "
+       << duration<double, std::milli>(t_read - t_start).count() << " ms"
+       << endl;
+  cerr << found << " solutions in "
+       << duration<double, std::milli>(t_end - t_read).count() << " ms"
+       << endl;
+  return 0;
+}
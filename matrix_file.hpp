@@ -0,0 +1,173 @@
+#ifndef DANCING_LINKS_MATRIX_FILE_HPP_
+#define DANCING_LINKS_MATRIX_FILE_HPP_
+
+#include "dancing_links.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DancingLinks {
+
+/**
+ * Binary matrix file, in the byte order of the machine that wrote it:
+ *
+ *   MatrixFileHeader
+ *   uint8_t  secondary[n_cols]      non zero for secondary columns,
+ *                                   padded with zeros to a multiple of 8
+ *   uint64_t offsets[n_rows + 1]    see SparseRows
+ *   uint32_t columns[n_ones]
+ *
+ * Every array starts at a multiple of 8 bytes, so a mapped file is used in
+ * place.
+ */
+struct MatrixFileHeader {
+  static constexpr char MAGIC[8] = {'D', 'L', 'X', 'M', 'A', 'T', 'R', '1'};
+  // written as 1, reads differently on a machine of other byte order.
+  static constexpr uint32_t ORDER_MARK = 1;
+
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t reserved;
+  uint64_t n_rows, n_cols, n_ones;
+
+  static size_t FlagsSize(uint64_t n_cols) { return (n_cols + 7) / 8 * 8; }
+};
+
+/**
+ * Write the matrix in the format described at MatrixFileHeader.
+ * @return false if the file could not be written
+ */
+inline bool WriteMatrixFile(const std::string &path, const SparseRows &matrix) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    return false;
+  }
+
+  MatrixFileHeader header{};
+  std::memcpy(header.magic, MatrixFileHeader::MAGIC, sizeof(header.magic));
+  header.byte_order = MatrixFileHeader::ORDER_MARK;
+  header.n_rows = matrix.Rows();
+  header.n_cols = matrix.secondary.size();
+  header.n_ones = matrix.columns.size();
+  out.write((const char *)&header, sizeof(header));
+
+  std::vector<uint8_t> flags(MatrixFileHeader::FlagsSize(header.n_cols), 0);
+  std::copy(begin(matrix.secondary), end(matrix.secondary), begin(flags));
+  out.write((const char *)flags.data(), flags.size());
+
+  // a matrix without rows still has the leading offset.
+  uint64_t zero = 0;
+  if (matrix.offsets.empty()) {
+    out.write((const char *)&zero, sizeof(zero));
+  } else {
+    out.write((const char *)matrix.offsets.data(),
+              matrix.offsets.size_bytes());
+  }
+  out.write((const char *)matrix.columns.data(), matrix.columns.size_bytes());
+  return (bool)out.flush();
+}
+
+/**
+ * Matrix file mapped read only into memory. Rows() views the mapping, so it
+ * is valid as long as this object lives.
+ */
+class MappedMatrix final {
+public:
+  /**
+   * Map and check the file. Offsets and columns are checked against the
+   * sizes in the header, so a corrupted file is rejected instead of read
+   * out of bounds.
+   * @return nothing if the file can't be mapped or is not a valid matrix
+   */
+  static std::optional<MappedMatrix> Open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      return std::nullopt;
+    }
+
+    MappedMatrix ret(data, (size_t)st.st_size);
+    if (!ret.Check()) {
+      return std::nullopt;
+    }
+    return ret;
+  }
+
+  MappedMatrix(MappedMatrix &&other) noexcept
+      : data(std::exchange(other.data, nullptr)), size(other.size),
+        rows(other.rows) {}
+  MappedMatrix(const MappedMatrix &) = delete;
+  MappedMatrix &operator=(const MappedMatrix &) = delete;
+
+  ~MappedMatrix() {
+    if (data) {
+      ::munmap(data, size);
+    }
+  }
+
+  const SparseRows &Rows() const { return rows; }
+
+private:
+  MappedMatrix(void *data, size_t size) : data(data), size(size) {}
+
+  bool Check() {
+    MatrixFileHeader header;
+    if (size < sizeof(header)) {
+      return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MatrixFileHeader::MAGIC,
+                    sizeof(header.magic)) != 0 ||
+        header.byte_order != MatrixFileHeader::ORDER_MARK ||
+        header.n_rows >= UINT32_MAX || header.n_cols >= UINT32_MAX ||
+        header.n_ones >= UINT32_MAX) {
+      return false;
+    }
+
+    size_t flags_size = MatrixFileHeader::FlagsSize(header.n_cols);
+    size_t expected = sizeof(header) + flags_size +
+                      (header.n_rows + 1) * sizeof(uint64_t) +
+                      header.n_ones * sizeof(uint32_t);
+    if (size != expected) {
+      return false;
+    }
+
+    const char *p = (const char *)data + sizeof(header);
+    rows.secondary = {(const uint8_t *)p, header.n_cols};
+    p += flags_size;
+    rows.offsets = {(const uint64_t *)p, header.n_rows + 1};
+    p += (header.n_rows + 1) * sizeof(uint64_t);
+    rows.columns = {(const uint32_t *)p, header.n_ones};
+
+    if (rows.offsets.front() != 0 || rows.offsets.back() != header.n_ones ||
+        !std::is_sorted(begin(rows.offsets), end(rows.offsets))) {
+      return false;
+    }
+    return std::all_of(begin(rows.columns), end(rows.columns),
+                       [&](uint32_t c) { return c < header.n_cols; });
+  }
+
+  void *data;
+  size_t size;
+  SparseRows rows;
+};
+
+} // namespace DancingLinks
+
+#endif
@@ -1,12 +1,23 @@
 #include "sudoku.h"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
 #include <cctype>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
 using std::cout;
 using std::endl;
@@ -19,6 +30,10 @@ const char *COLOR_RED = "\033[1;31m";
 const char *COLOR_DEFAULT = "\033[0;49m";
 
 namespace sudoku {
+// true for a non zero mask with one bit set; std::has_single_bit is a
+// library call without -mpopcnt.
+static bool SingleBit(uint64_t mask) { return (mask & (mask - 1)) == 0; }
+
 // SudokuBoard implementation
 SudokuBoard::SudokuBoard(unsigned side) : side(side) {
   unsigned total = side * side;
@@ -31,6 +46,12 @@ SudokuBoard::SudokuBoard(unsigned side) : side(side) {
 }
 
 SudokuBoard SudokuBoard::FromString(const std::string &example) {
+  auto board = Parse(example);
+  assert(board);
+  return *board;
+}
+
+std::optional<SudokuBoard> SudokuBoard::Parse(const std::string &example) {
   vector<int> tokens;
   if (example.find('|') == std::string::npos) {
     tokens = GetSingleDigitTokens(example);
@@ -39,7 +60,15 @@ SudokuBoard SudokuBoard::FromString(const std::string &example) {
   }
   unsigned total = tokens.size();
   unsigned side = std::sqrt(total);
-  assert(side * side == total);
+  unsigned box_size = std::sqrt(side);
+  if (total == 0 || side * side != total || box_size * box_size != side) {
+    return std::nullopt;
+  }
+  for (int t : tokens) {
+    if (t < -1 || t >= (int)side) {
+      return std::nullopt;
+    }
+  }
 
   SudokuBoard board(side);
   board.vals.clear();
@@ -57,6 +86,17 @@ SudokuBoard SudokuBoard::FromString(const std::string &example) {
 
 SudokuBoard SudokuBoard::Empty(unsigned side) { return SudokuBoard(side); }
 
+SudokuBoard SudokuBoard::FromValues(unsigned side,
+                                    const std::vector<int> &vals) {
+  assert(vals.size() == side * side);
+  SudokuBoard board(side);
+  board.vals = vals;
+  for (unsigned i = 0; i < vals.size(); i++) {
+    board.predefined[i] = vals[i] >= 0;
+  }
+  return board;
+}
+
 vector<int> SudokuBoard::GetSingleDigitTokens(const std::string &example) {
   vector<int> tokens;
   for (char c : example) {
@@ -75,10 +115,10 @@ vector<int> SudokuBoard::GetMultiDigitTokens(const std::string &example) {
       continue;
     if (token == ".." || token == ".")
       tokens.push_back(-1);
-    else {
-      unsigned num = std::stoi(token);
-      tokens.push_back(num - 1);
-    }
+    else if (std::isdigit(token[0]) && token.size() <= 4)
+      tokens.push_back(std::stoi(token) - 1);
+    else
+      tokens.push_back(-2); // rejected by Parse
   }
   return tokens;
 }
@@ -117,6 +157,161 @@ void SudokuBoard::Print(bool ignore_colors) {
   }
 }
 
+std::string SudokuBoard::ToString() const {
+  std::string ret;
+  if (side <= 9) {
+    for (int v : vals) {
+      ret += v < 0 ? '.' : (char)('1' + v);
+    }
+    return ret;
+  }
+
+  ret = "|";
+  for (int v : vals) {
+    ret += v < 0 ? " ." : " " + std::to_string(v + 1);
+  }
+  return ret;
+}
+
+bool SudokuBoard::Propagate() {
+  if (side > 64) {
+    return true;
+  }
+  unsigned box_size = std::sqrt(side);
+  unsigned total = side * side;
+  uint64_t all = side == 64 ? ~0ull : (1ull << side) - 1;
+
+  // cells of every row, column and box, and the box of every cell.
+  vector<unsigned> units(3 * total), box(total);
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      unsigned b = (r / box_size) * box_size + c / box_size;
+      unsigned k = (r % box_size) * box_size + c % box_size;
+      box[r * side + c] = b;
+      units[r * side + c] = r * side + c;
+      units[total + c * side + r] = r * side + c;
+      units[2 * total + b * side + k] = r * side + c;
+    }
+  }
+
+  // numbers used in every row, column and box.
+  vector<uint64_t> used(3 * side, 0);
+  for (unsigned i = 0; i < total; i++) {
+    if (vals[i] < 0) {
+      continue;
+    }
+    uint64_t bit = 1ull << vals[i];
+    for (unsigned u : {i / side, side + i % side, 2 * side + box[i]}) {
+      if (used[u] & bit) {
+        return false;
+      }
+      used[u] |= bit;
+    }
+  }
+
+  // candidates of every empty cell. Cells left with a single one are
+  // pushed to the singles stack, every cell at most once.
+  vector<uint64_t> cand(total, 0);
+  vector<unsigned> singles(total);
+  unsigned n_singles = 0;
+  for (unsigned i = 0; i < total; i++) {
+    if (vals[i] < 0) {
+      cand[i] = all & ~(used[i / side] | used[side + i % side] |
+                        used[2 * side + box[i]]);
+      if (cand[i] == 0) {
+        return false;
+      }
+      if (SingleBit(cand[i])) {
+        singles[n_singles++] = i;
+      }
+    }
+  }
+
+  // fill the cell and remove the number from candidates of its peers.
+  auto place = [&](unsigned i, unsigned n) {
+    uint64_t bit = 1ull << n;
+    if (!(cand[i] & bit)) {
+      return false;
+    }
+    vals[i] = (int)n;
+    cand[i] = 0;
+    for (unsigned u : {i / side, side + i % side, 2 * side + box[i]}) {
+      for (unsigned k = 0; k < side; k++) {
+        unsigned p = units[u * side + k];
+        if (cand[p] & bit) {
+          cand[p] &= ~bit;
+          if (cand[p] == 0) {
+            return false;
+          }
+          if (SingleBit(cand[p])) {
+            singles[n_singles++] = p;
+          }
+        }
+      }
+    }
+    return true;
+  };
+
+  // place naked singles found so far.
+  auto drain = [&] {
+    while (n_singles > 0) {
+      unsigned i = singles[--n_singles];
+      if (vals[i] < 0 && !place(i, std::countr_zero(cand[i]))) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  if (!drain()) {
+    return false;
+  }
+  for (;;) {
+    bool found = false;
+    for (unsigned u = 0; u < 3 * side; u++) {
+      const unsigned *cells = &units[u * side];
+      // numbers placed, possible in at least one and in at least two cells.
+      uint64_t placed = 0, once = 0, twice = 0;
+      for (unsigned k = 0; k < side; k++) {
+        unsigned i = cells[k];
+        if (vals[i] >= 0) {
+          placed |= 1ull << vals[i];
+        } else {
+          twice |= once & cand[i];
+          once |= cand[i];
+        }
+      }
+      if ((placed | once) != all) {
+        return false;
+      }
+
+      uint64_t hidden = once & ~twice;
+      for (unsigned k = 0; k < side && hidden; k++) {
+        unsigned i = cells[k];
+        uint64_t single = cand[i] & hidden;
+        if (single) {
+          // two numbers with the single place in the same cell.
+          if (!SingleBit(single)) {
+            return false;
+          }
+          hidden &= ~single;
+          if (!place(i, std::countr_zero(single)) || !drain()) {
+            return false;
+          }
+          found = true;
+        }
+      }
+    }
+    if (!found) {
+      return true;
+    }
+  }
+}
+
+bool SudokuBoard::IsComplete() const {
+  return std::find(begin(vals), end(vals), -1) == end(vals);
+}
+
 // SudokuMapper implementation
 SudokuMapper::SudokuMapper(std::shared_ptr<SudokuBoard> board) : board(board) {}
 
@@ -124,6 +319,11 @@ SudokuMapper::Mapping::Mapping(unsigned r, unsigned c, unsigned n,
                                unsigned side)
     : r(r), c(c), n(n), side(side) {}
 
+SudokuMapper::Mapping SudokuMapper::Mapping::FromRow(unsigned row,
+                                                    unsigned side) {
+  return Mapping(row / (side * side), row / side % side, row % side, side);
+}
+
 unsigned SudokuMapper::Mapping::Row() const {
   return r * side * side + c * side + n;
 }
@@ -144,15 +344,44 @@ unsigned SudokuMapper::Mapping::IntersectionCol() const {
   return 3 * side * side + r * side + c;
 }
 
-std::unique_ptr<DancingLinks::DLSolver> SudokuMapper::DlInstance() {
+template <typename Solver>
+const Solver &SudokuMapper::CachedTemplate(unsigned side) {
+  struct Entry {
+    std::once_flag built;
+    std::unique_ptr<Solver> solver;
+  };
+  static std::mutex mutex;
+  // nodes of a map stay in place, so entries are used outside the lock.
+  static std::map<unsigned, Entry> templates;
+
+  Entry *entry;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    entry = &templates[side];
+  }
+  // only users of the same side wait for the template being built.
+  std::call_once(entry->built, [entry, side] {
+    auto ret = std::make_unique<Solver>(side * side * side, side * side * 4);
+    Populate(ret.get(), side);
+    if constexpr (std::is_same_v<Solver, DancingLinks::BitsetSolver>) {
+      ret->Prepare();
+    }
+    entry->solver = std::move(ret);
+  });
+  return *entry->solver;
+}
+
+const DancingLinks::DLSolver &
+SudokuMapper::EmptyBoardTemplate(unsigned side) {
+  return CachedTemplate<DancingLinks::DLSolver>(side);
+}
+
+template <typename Solver> std::unique_ptr<Solver> SudokuMapper::Instance() {
   auto &sb = *board;
-  auto ret = std::make_unique<DancingLinks::DLSolver>(
-      sb.GetSide() * sb.GetSide() * sb.GetSide(),
-      sb.GetSide() * sb.GetSide() * 4);
+  // copying the template is a bulk copy of its arrays.
+  auto ret = std::make_unique<Solver>(CachedTemplate<Solver>(sb.GetSide()));
   auto &solver = *ret;
 
-  Populate(&solver);
-
   // remove DL rows for filled grids.
   for (unsigned r = 0; r < sb.GetSide(); r++) {
     for (unsigned c = 0; c < sb.GetSide(); c++) {
@@ -167,20 +396,111 @@ std::unique_ptr<DancingLinks::DLSolver> SudokuMapper::DlInstance() {
   return ret;
 }
 
+template <typename Solver>
+std::unique_ptr<Solver> SudokuMapper::ResidualInstance() {
+  auto &sb = *board;
+  unsigned side = sb.GetSide();
+  unsigned n_cols = 4 * side * side;
+
+  // columns covered by filled cells. A column covered twice means two
+  // filled cells conflict.
+  std::vector<bool> closed(n_cols, false);
+  bool conflict = false;
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      int n = sb.Get(r, c);
+      if (n >= 0) {
+        Mapping m(r, c, (unsigned)n, side);
+        for (unsigned col : {m.ColumnCol(), m.RowCol(), m.AreaCol(),
+                             m.IntersectionCol()}) {
+          conflict |= closed[col];
+          closed[col] = true;
+        }
+      }
+    }
+  }
+
+  // open columns are renumbered, keeping their order.
+  std::vector<unsigned> col_id(n_cols);
+  unsigned n_open = 0;
+  for (unsigned col = 0; col < n_cols; col++) {
+    col_id[col] = n_open;
+    n_open += !closed[col];
+  }
+
+  // an extra column without rows leaves a conflicting board without solution.
+  auto ret = std::make_unique<Solver>(side * side * side, n_open + conflict);
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      if (sb.Get(r, c) >= 0) {
+        continue;
+      }
+      // rows and all columns but the cell one are consecutive in the number.
+      Mapping m(r, c, 0, side);
+      unsigned row = m.Row(), cell = col_id[m.IntersectionCol()];
+      unsigned column = m.ColumnCol(), line = m.RowCol(), area = m.AreaCol();
+      for (unsigned n = 0; n < side; n++) {
+        if (closed[column + n] || closed[line + n] || closed[area + n]) {
+          continue;
+        }
+        ret->Add(row + n, col_id[column + n]);
+        ret->Add(row + n, col_id[line + n]);
+        ret->Add(row + n, col_id[area + n]);
+        ret->Add(row + n, cell);
+      }
+    }
+  }
+  return ret;
+}
+
+std::unique_ptr<DancingLinks::DLSolver> SudokuMapper::DlInstance() {
+  if (board->GetSide() == 9) {
+    return FixedSudokuSolver<9>::Create(*board);
+  }
+  if (board->GetSide() < RESIDUAL_MIN_SIDE) {
+    return Instance<DancingLinks::DLSolver>();
+  }
+  return ResidualInstance<DancingLinks::DLSolver>();
+}
+
+std::unique_ptr<DancingLinks::BitsetSolver> SudokuMapper::BitsetInstance() {
+  return Instance<DancingLinks::BitsetSolver>();
+}
+
+DancingLinks::SearchStatus
+SudokuMapper::Solve(const DancingLinks::SearchLimits &limits) {
+  using DancingLinks::SearchStatus;
+  if (!board->Propagate()) {
+    return SearchStatus::NoSolution;
+  }
+  if (board->IsComplete()) {
+    return SearchStatus::Solved;
+  }
+
+  DancingLinks::SolveResult result;
+  if (board->GetSide() <= BITSET_MAX_SIDE) {
+    result = BitsetInstance()->Solve(limits);
+  } else {
+    result = DlInstance()->Solve(limits);
+  }
+  RevMap(result.rows);
+  return result.status;
+}
+
 void SudokuMapper::RevMap(const std::vector<int> &solution) {
   for (auto i : solution) {
-    auto coord = dl_row_to_sudoku_field[i];
-    board->Set(coord.r, coord.c, coord.n);
+    auto m = Mapping::FromRow(i, board->GetSide());
+    board->Set(m.r, m.c, m.n);
   }
 }
 
-void SudokuMapper::Populate(DancingLinks::DLSolver *solver) {
-  for (unsigned sudo_row = 0; sudo_row < board->GetSide(); sudo_row++) {
-    for (unsigned sudo_col = 0; sudo_col < board->GetSide(); sudo_col++) {
-      for (unsigned num = 0; num < board->GetSide(); num++) {
-        Mapping m(sudo_row, sudo_col, num, board->GetSide());
+template <typename Solver>
+void SudokuMapper::Populate(Solver *solver, unsigned side) {
+  for (unsigned sudo_row = 0; sudo_row < side; sudo_row++) {
+    for (unsigned sudo_col = 0; sudo_col < side; sudo_col++) {
+      for (unsigned num = 0; num < side; num++) {
+        Mapping m(sudo_row, sudo_col, num, side);
         unsigned row = m.Row();
-        dl_row_to_sudoku_field[row] = Coord(sudo_row, sudo_col, num);
 
         solver->Add(row, m.ColumnCol());
         solver->Add(row, m.RowCol());
@@ -191,6 +511,693 @@ void SudokuMapper::Populate(DancingLinks::DLSolver *solver) {
   }
 }
 
+namespace {
+constexpr unsigned BoxSize(unsigned side) {
+  unsigned box = 1;
+  while ((box + 1) * (box + 1) <= side) {
+    box++;
+  }
+  return box;
+}
+
+// Same rows and columns as SudokuMapper::Populate.
+template <unsigned SIDE> constexpr auto EmptyBoardMatrix() {
+  using Fixed = FixedSudokuSolver<SIDE>;
+  constexpr unsigned box = BoxSize(SIDE);
+  static_assert(box * box == SIDE);
+
+  DancingLinks::StaticMatrix<Fixed::N_ROWS, Fixed::N_COLS, 0, 4 * Fixed::N_ROWS>
+      matrix;
+  for (unsigned r = 0; r < SIDE; r++) {
+    for (unsigned c = 0; c < SIDE; c++) {
+      unsigned area = r / box * box + c / box;
+      for (unsigned n = 0; n < SIDE; n++) {
+        unsigned row = (r * SIDE + c) * SIDE + n;
+        matrix.Add(row, c * SIDE + n);
+        matrix.Add(row, SIDE * SIDE + r * SIDE + n);
+        matrix.Add(row, 2 * SIDE * SIDE + area * SIDE + n);
+        matrix.Add(row, 3 * SIDE * SIDE + r * SIDE + c);
+      }
+    }
+  }
+  return matrix;
+}
+
+template <unsigned SIDE>
+constexpr auto EMPTY_BOARD_MATRIX = EmptyBoardMatrix<SIDE>();
+} // namespace
+
+template <unsigned SIDE>
+std::unique_ptr<DancingLinks::DLSolver>
+FixedSudokuSolver<SIDE>::Create(const SudokuBoard &board) {
+  assert(board.GetSide() == SIDE);
+  auto ret = std::make_unique<DancingLinks::DLSolver>(EMPTY_BOARD_MATRIX<SIDE>);
+  for (unsigned r = 0; r < SIDE; r++) {
+    for (unsigned c = 0; c < SIDE; c++) {
+      int n = board.Get(r, c);
+      if (n >= 0) {
+        ret->DeleteRow((r * SIDE + c) * SIDE + (unsigned)n);
+      }
+    }
+  }
+  return ret;
+}
+
+template class FixedSudokuSolver<9>;
+template class FixedSudokuSolver<16>;
+
+// SudokuGenerator implementation
+SudokuGenerator::SudokuGenerator(unsigned side, uint64_t seed,
+                                 uint64_t check_nodes)
+    : side(side), rng(seed), matrix(SudokuMapper::EmptyBoardTemplate(side)),
+      check_nodes(check_nodes) {}
+
+std::optional<SudokuBoard> SudokuGenerator::Solved() {
+  // runs long enough to fill the board, restarts cut the heavy tail of
+  // bigger boards.
+  DancingLinks::DLSolver solver(matrix);
+  auto result = solver.RestartSolve(rng(), 32 * side * side);
+  // the search has no limits, so it is not Aborted.
+  if (result.status != DancingLinks::SearchStatus::Solved) {
+    return std::nullopt;
+  }
+
+  std::vector<int> vals(side * side);
+  for (int row : result.rows) {
+    // row ids of SudokuMapper: (r * side + c) * side + n.
+    vals[row / side] = row % side;
+  }
+  return SudokuBoard::FromValues(side, vals);
+}
+
+std::optional<SudokuBoard> SudokuGenerator::Generate() {
+  auto solved = Solved();
+  if (!solved) {
+    return std::nullopt;
+  }
+  std::vector<int> vals(side * side);
+  for (unsigned i = 0; i < vals.size(); i++) {
+    vals[i] = solved->Get(i / side, i % side);
+  }
+
+  std::vector<unsigned> order(vals.size());
+  for (unsigned i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::shuffle(begin(order), end(order), rng);
+
+  // clues not tried yet stay assumed, the next one on top, so leaving it out
+  // is a Retract.
+  for (unsigned k = order.size(); k-- > 0;) {
+    matrix.Assume(order[k] * side + (unsigned)vals[order[k]]);
+  }
+
+  for (unsigned i : order) {
+    matrix.Retract();
+    int clue = vals[i];
+    vals[i] = -1;
+    if (!Unique(vals)) {
+      vals[i] = clue;
+    }
+  }
+  return SudokuBoard::FromValues(side, vals);
+}
+
+bool SudokuGenerator::Unique(const std::vector<int> &vals) {
+  // singles only make deductions, a board they fill has one solution.
+  auto board = SudokuBoard::FromValues(side, vals);
+  if (!board.Propagate()) {
+    return false;
+  }
+  if (board.IsComplete()) {
+    return true;
+  }
+
+  // clues not tried yet are assumed by Generate, the kept ones only for this
+  // check.
+  search_checks++;
+  size_t base = matrix.Assumed();
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      int n = vals[r * side + c];
+      if (n >= 0) {
+        // refused for the cells assumed already.
+        matrix.Assume((r * side + c) * side + (unsigned)n);
+      }
+    }
+  }
+  DancingLinks::SearchLimits limits;
+  limits.max_nodes = check_nodes;
+  auto result = matrix.Count(2, limits);
+  aborted_checks += result.status == DancingLinks::SearchStatus::Aborted;
+  // a check given up keeps the clue, the puzzle stays unique.
+  bool unique =
+      result.status != DancingLinks::SearchStatus::Aborted && result.count == 1;
+  while (matrix.Assumed() > base) {
+    matrix.Retract();
+  }
+  return unique;
+}
+
+// SudokuSymmetry implementation
+namespace {
+// Transformations Canonicalize may keep at once, more are given up.
+constexpr size_t MAX_CANONICAL_STATES = 1024;
+constexpr unsigned MAX_CANONICAL_SIDE = 64;
+constexpr unsigned MAX_CANONICAL_BOX = 8;
+
+using Line = std::array<uint8_t, MAX_CANONICAL_SIDE>;
+
+// Transformation with the first rows of the canonical form chosen. Columns
+// and stacks these rows don't tell apart are tied, their order is open.
+// Fixed size, states are copied a lot.
+struct CanonicalState {
+  bool transposed = false;
+  Line rows;
+  // original stacks in order, stack_tied[k] if slot k is tied to k - 1.
+  std::array<uint8_t, MAX_CANONICAL_BOX> stacks, stack_tied;
+  // columns of every original stack in order, tied like stacks.
+  Line cols, col_tied;
+  // 1 + label of every number, 0 until it is seen.
+  Line labels;
+  uint8_t next_label = 1;
+};
+
+// Order of a state refined by one more row of the board.
+struct Refinement {
+  std::array<uint8_t, MAX_CANONICAL_BOX> stacks, stack_tied;
+  Line cols, col_tied;
+  // code of every position of every original stack: 0 empty, label for a
+  // labeled number and side + 1 + i for the i-th new one of the stack.
+  Line codes;
+  // (first, size) of columns, in cols, and of stack slots which get new
+  // numbers and are tied otherwise, so every order of them has to be tried.
+  std::vector<std::pair<unsigned, unsigned>> col_groups, stack_groups;
+};
+
+void Refine(const CanonicalState &state, const int *row, unsigned side,
+            unsigned box, Refinement &ret) {
+  ret.stacks = state.stacks;
+  ret.stack_tied = state.stack_tied;
+  ret.cols = state.cols;
+  ret.col_tied = state.col_tied;
+  ret.col_groups.clear();
+  ret.stack_groups.clear();
+  auto key = [&](uint8_t col) -> unsigned {
+    int n = row[col];
+    if (n < 0) {
+      return 0;
+    }
+    return state.labels[n] == 0 ? side + 1 : state.labels[n];
+  };
+
+  for (unsigned q = 0; q < box; q++) {
+    unsigned first = q * box, end = first + box, n_new = 0;
+    for (unsigned j0 = first; j0 < end;) {
+      unsigned j1 = j0 + 1;
+      while (j1 < end && state.col_tied[j1]) {
+        j1++;
+      }
+      std::sort(begin(ret.cols) + j0, begin(ret.cols) + j1,
+                [&](uint8_t a, uint8_t b) { return key(a) < key(b); });
+      unsigned cell_new = 0;
+      for (unsigned j = j0; j < j1; j++) {
+        unsigned k = key(ret.cols[j]);
+        if (k > side) {
+          k = side + 1 + n_new++;
+          cell_new++;
+        }
+        ret.codes[j] = (uint8_t)k;
+        ret.col_tied[j] = j > j0 && k == 0 && ret.codes[j - 1] == 0;
+      }
+      if (cell_new > 1) {
+        ret.col_groups.emplace_back(j1 - cell_new, cell_new);
+      }
+      j0 = j1;
+    }
+  }
+
+  auto codes = [&](uint8_t q) { return begin(ret.codes) + q * box; };
+  auto less = [&](uint8_t a, uint8_t b) {
+    return std::lexicographical_compare(codes(a), codes(a) + box, codes(b),
+                                        codes(b) + box);
+  };
+  for (unsigned k0 = 0; k0 < box;) {
+    unsigned k1 = k0 + 1;
+    while (k1 < box && state.stack_tied[k1]) {
+      k1++;
+    }
+    std::stable_sort(begin(ret.stacks) + k0, begin(ret.stacks) + k1, less);
+    for (unsigned k = k0; k < k1;) {
+      unsigned same = k + 1;
+      while (same < k1 && !less(ret.stacks[k], ret.stacks[same])) {
+        same++;
+      }
+      bool has_new =
+          std::any_of(codes(ret.stacks[k]), codes(ret.stacks[k]) + box,
+                      [&](uint8_t c) { return c > side; });
+      for (unsigned i = k; i < same; i++) {
+        ret.stack_tied[i] = i > k && !has_new;
+      }
+      if (same - k > 1 && has_new) {
+        ret.stack_groups.emplace_back(k, same - k);
+      }
+      k = same;
+    }
+    k0 = k1;
+  }
+}
+
+// Row of the canonical form given by the refinement: 0 for empty cells,
+// labels for numbers.
+void RowString(const CanonicalState &state, const Refinement &refined,
+               unsigned side, unsigned box, Line &out) {
+  unsigned next = state.next_label, i = 0;
+  for (unsigned k = 0; k < box; k++) {
+    for (unsigned j = 0; j < box; j++) {
+      unsigned code = refined.codes[refined.stacks[k] * box + j];
+      out[i++] = (uint8_t)(code > side ? next++ : code);
+    }
+  }
+}
+
+// Add a state for every order of the groups of the refinement.
+bool Expand(const CanonicalState &state, Refinement &refined, unsigned t,
+            unsigned x, const int *row, unsigned box,
+            std::vector<CanonicalState> &out) {
+  struct Group {
+    uint8_t *first;
+    unsigned size;
+  };
+  std::vector<Group> groups;
+  size_t n_orders = 1;
+  for (auto [first, size] : refined.col_groups) {
+    groups.push_back({refined.cols.data() + first, size});
+  }
+  for (auto [first, size] : refined.stack_groups) {
+    groups.push_back({refined.stacks.data() + first, size});
+  }
+  for (auto group : groups) {
+    for (unsigned i = 2; i <= group.size; i++) {
+      n_orders *= i;
+      if (n_orders + out.size() > MAX_CANONICAL_STATES) {
+        return false;
+      }
+    }
+    std::sort(group.first, group.first + group.size);
+  }
+
+  // every combination of orders, like counting with next_permutation.
+  for (;;) {
+    CanonicalState &child = out.emplace_back(state);
+    child.rows[t] = (uint8_t)x;
+    child.stacks = refined.stacks;
+    child.stack_tied = refined.stack_tied;
+    child.cols = refined.cols;
+    child.col_tied = refined.col_tied;
+    for (unsigned k = 0; k < box; k++) {
+      unsigned q = child.stacks[k];
+      for (unsigned j = 0; j < box; j++) {
+        int n = row[child.cols[q * box + j]];
+        if (n >= 0 && child.labels[n] == 0) {
+          child.labels[n] = child.next_label++;
+        }
+      }
+    }
+
+    size_t g = 0;
+    for (; g < groups.size(); g++) {
+      if (std::next_permutation(groups[g].first,
+                                groups[g].first + groups[g].size)) {
+        break;
+      }
+    }
+    if (g == groups.size()) {
+      return true;
+    }
+  }
+}
+} // namespace
+
+std::optional<SudokuSymmetry>
+SudokuSymmetry::Canonicalize(const SudokuBoard &board) {
+  unsigned side = board.GetSide(), box = BoxSize(side);
+  if (side > MAX_CANONICAL_SIDE) {
+    return std::nullopt;
+  }
+  // board and its transposition.
+  std::vector<int> vals[2];
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      vals[0].push_back(board.Get(r, c));
+      vals[1].push_back(board.Get(c, r));
+    }
+  }
+
+  std::vector<CanonicalState> states, next;
+  for (bool transposed : {false, true}) {
+    CanonicalState &state = states.emplace_back();
+    state.transposed = transposed;
+    for (unsigned i = 0; i < side; i++) {
+      state.cols[i] = (uint8_t)i;
+      state.col_tied[i] = i % box != 0;
+      state.labels[i] = 0;
+    }
+    for (unsigned k = 0; k < box; k++) {
+      state.stacks[k] = (uint8_t)k;
+      state.stack_tied[k] = k != 0;
+    }
+  }
+
+  Refinement refined;
+  Line best, row_string;
+  for (unsigned t = 0; t < side; t++) {
+    next.clear();
+    for (auto &state : states) {
+      // the next row comes from the band of the previous one, or starts an
+      // unused band.
+      uint64_t used = 0;
+      for (unsigned i = t - t % box; i < t; i++) {
+        used |= uint64_t(1) << state.rows[i];
+      }
+      for (unsigned i = 0; i < t - t % box; i += box) {
+        used |= (~uint64_t(0) >> (64 - box)) << (state.rows[i] / box * box);
+      }
+      unsigned band_first = t % box == 0 ? 0 : state.rows[t - 1] / box * box;
+      unsigned band_end = t % box == 0 ? side : band_first + box;
+
+      const int *vals_t = vals[state.transposed].data();
+      for (unsigned x = band_first; x < band_end; x++) {
+        if (used >> x & 1) {
+          continue;
+        }
+        const int *row = vals_t + x * side;
+        Refine(state, row, side, box, refined);
+        RowString(state, refined, side, box, row_string);
+        int order = next.empty() ? -1
+                                 : std::memcmp(row_string.data(), best.data(),
+                                               side);
+        if (order > 0) {
+          continue;
+        }
+        if (order < 0) {
+          best = row_string;
+          next.clear();
+        }
+        if (!Expand(state, refined, t, x, row, box, next) ||
+            next.size() > MAX_CANONICAL_STATES) {
+          return std::nullopt;
+        }
+      }
+    }
+    std::swap(states, next);
+  }
+
+  // ties left are identical, any of the states gives the canonical form.
+  const auto &state = states.front();
+  SudokuSymmetry ret;
+  ret.transposed = state.transposed;
+  ret.rows.assign(begin(state.rows), begin(state.rows) + side);
+  for (unsigned k = 0; k < box; k++) {
+    for (unsigned j = 0; j < box; j++) {
+      ret.cols.push_back(state.cols[state.stacks[k] * box + j]);
+    }
+  }
+  int next_label = state.next_label;
+  for (unsigned n = 0; n < side; n++) {
+    ret.numbers.push_back(state.labels[n] == 0 ? next_label++
+                                               : state.labels[n]);
+    ret.numbers.back()--;
+  }
+  return ret;
+}
+
+SudokuBoard SudokuSymmetry::Apply(const SudokuBoard &board) const {
+  unsigned side = board.GetSide();
+  std::vector<int> vals(side * side);
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      unsigned x = rows[r], y = cols[c];
+      int n = transposed ? board.Get(y, x) : board.Get(x, y);
+      vals[r * side + c] = n < 0 ? -1 : numbers[n];
+    }
+  }
+  return SudokuBoard::FromValues(side, vals);
+}
+
+SudokuBoard SudokuSymmetry::Invert(const SudokuBoard &board) const {
+  unsigned side = board.GetSide();
+  std::vector<int> original(side);
+  for (unsigned n = 0; n < side; n++) {
+    original[numbers[n]] = (int)n;
+  }
+  std::vector<int> vals(side * side);
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      unsigned x = rows[r], y = cols[c];
+      int n = board.Get(r, c);
+      vals[transposed ? y * side + x : x * side + y] = n < 0 ? -1 : original[n];
+    }
+  }
+  return SudokuBoard::FromValues(side, vals);
+}
+
+// SudokuSolutionCache implementation
+SudokuSolutionCache::SudokuSolutionCache(size_t capacity)
+    : capacity(capacity) {
+  assert(capacity > 0);
+}
+
+DancingLinks::SearchStatus
+SudokuSolutionCache::Solve(std::shared_ptr<SudokuBoard> board,
+                           const DancingLinks::SearchLimits &limits) {
+  using DancingLinks::SearchStatus;
+  auto symmetry = SudokuSymmetry::Canonicalize(*board);
+  if (!symmetry) {
+    return SudokuMapper(board).Solve(limits);
+  }
+  std::string key = symmetry->Apply(*board).ToString();
+  unsigned side = board->GetSide();
+
+  std::optional<Entry> found;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it != index.end()) {
+      entries.splice(begin(entries), entries, it->second);
+      found = *it->second;
+      hits++;
+    } else {
+      misses++;
+    }
+  }
+  if (found) {
+    if (found->status == SearchStatus::Solved) {
+      auto solved =
+          symmetry->Invert(SudokuBoard::FromValues(side, found->solution));
+      for (unsigned r = 0; r < side; r++) {
+        for (unsigned c = 0; c < side; c++) {
+          if (board->Get(r, c) < 0) {
+            board->Set(r, c, solved.Get(r, c));
+          }
+        }
+      }
+    }
+    return found->status;
+  }
+
+  auto status = SudokuMapper(board).Solve(limits);
+  if (status == SearchStatus::Aborted) {
+    return status;
+  }
+  Entry entry{key, status, {}};
+  if (status == SearchStatus::Solved) {
+    auto canonical = symmetry->Apply(*board);
+    for (unsigned r = 0; r < side; r++) {
+      for (unsigned c = 0; c < side; c++) {
+        entry.solution.push_back(canonical.Get(r, c));
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (index.count(key) == 0) {
+    entries.push_front(std::move(entry));
+    index.emplace(key, begin(entries));
+    if (entries.size() > capacity) {
+      index.erase(entries.back().key);
+      entries.pop_back();
+    }
+  }
+  return status;
+}
+
+uint64_t SudokuSolutionCache::Hits() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return hits;
+}
+
+uint64_t SudokuSolutionCache::Misses() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return misses;
+}
+
+// SudokuBatch implementation
+namespace {
+
+/**
+ * Puzzles read, but not written yet. Workers take puzzles from `input` and
+ * put results into `output`, which is written in the input order.
+ */
+class BatchQueue final {
+public:
+  BatchQueue(size_t max_in_flight, std::ostream &out)
+      : max_in_flight(max_in_flight), out(out) {}
+
+  // called by the reader, blocks while too many puzzles wait for output.
+  void Push(std::string line) {
+    std::unique_lock<std::mutex> lock(mutex);
+    space.wait(lock, [this] { return read - written < max_in_flight; });
+    input.emplace_back(read++, std::move(line));
+    work.notify_one();
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    eof = true;
+    work.notify_all();
+  }
+
+  bool Pop(uint64_t &id, std::string &line) {
+    std::unique_lock<std::mutex> lock(mutex);
+    work.wait(lock, [this] { return !input.empty() || eof; });
+    if (input.empty()) {
+      return false;
+    }
+    id = input.front().first;
+    line = std::move(input.front().second);
+    input.pop_front();
+    return true;
+  }
+
+  void Done(uint64_t id, std::string result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    output.emplace(id, std::move(result));
+    while (!output.empty() && output.begin()->first == written) {
+      out << output.begin()->second << '\n';
+      output.erase(output.begin());
+      written++;
+    }
+    space.notify_one();
+  }
+
+private:
+  size_t max_in_flight;
+  std::ostream &out;
+
+  std::mutex mutex;
+  std::condition_variable work, space;
+
+  std::deque<std::pair<uint64_t, std::string>> input;
+  std::map<uint64_t, std::string> output;
+  uint64_t read = 0, written = 0;
+  bool eof = false;
+};
+
+} // namespace
+
+SudokuBatch::SudokuBatch(unsigned n_threads)
+    : SudokuBatch(n_threads, Limits{}) {}
+
+SudokuBatch::SudokuBatch(unsigned n_threads, const Limits &limits,
+                         SudokuSolutionCache *cache)
+    : n_threads(std::max(1u, n_threads)), limits(limits), cache(cache) {}
+
+std::vector<double> SudokuBatch::Run(std::istream &in,
+                                     std::ostream &out) const {
+  using std::chrono::steady_clock;
+  BatchQueue queue(64 * n_threads, out);
+  vector<vector<double>> latencies(n_threads);
+
+  auto work = [&](unsigned worker) {
+    uint64_t id;
+    std::string line;
+    while (queue.Pop(id, line)) {
+      auto t_start = steady_clock::now();
+      auto result = Solve(line);
+      auto t_end = steady_clock::now();
+      latencies[worker].push_back(
+          std::chrono::duration<double, std::micro>(t_end - t_start).count());
+      queue.Done(id, std::move(result));
+    }
+  };
+
+  vector<std::thread> workers;
+  for (unsigned i = 0; i < n_threads; i++) {
+    workers.emplace_back(work, i);
+  }
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (IsPuzzle(line)) {
+      queue.Push(std::move(line));
+    }
+  }
+  queue.Close();
+
+  for (auto &t : workers) {
+    t.join();
+  }
+
+  vector<double> all;
+  for (auto &l : latencies) {
+    all.insert(end(all), begin(l), end(l));
+  }
+  std::sort(begin(all), end(all));
+  return all;
+}
+
+std::string SudokuBatch::Solve(const std::string &line) const {
+  auto board = SudokuBoard::Parse(line);
+  if (!board) {
+    return "INVALID";
+  }
+
+  DancingLinks::SearchLimits search;
+  search.max_nodes = limits.nodes;
+  if (limits.milliseconds != 0) {
+    search.deadline = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(limits.milliseconds);
+  }
+
+  auto sb = std::make_shared<SudokuBoard>(*board);
+  auto status =
+      cache ? cache->Solve(sb, search) : SudokuMapper(sb).Solve(search);
+  switch (status) {
+  case DancingLinks::SearchStatus::Solved:
+    return sb->ToString();
+  case DancingLinks::SearchStatus::NoSolution:
+    return "NO ANSWER";
+  case DancingLinks::SearchStatus::Aborted:
+    break;
+  }
+  return "ABORTED";
+}
+
+bool SudokuBatch::IsPuzzle(const std::string &line) {
+  auto first = line.find_first_not_of(" \t\r");
+  return first != std::string::npos && line[first] != '#';
+}
+
+double SudokuBatch::Percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  p = std::clamp(p, 0.0, 100.0);
+  size_t rank = (size_t)(p / 100 * (sorted.size() - 1) + 0.5);
+  return sorted[rank];
+}
+
 std::unique_ptr<DancingLinks::DLSolver>
 CreateSudokuSolver(const std::string &puzzle) {
   auto board = std::make_shared<SudokuBoard>(SudokuBoard::FromString(puzzle));
@@ -199,6 +1206,10 @@ CreateSudokuSolver(const std::string &puzzle) {
 }
 
 std::unique_ptr<DancingLinks::DLSolver> CreateEmptySudokuSolver(unsigned side) {
+  // nothing to leave out of an empty board, copying the whole matrix wins.
+  if (side == 16) {
+    return FixedSudokuSolver<16>::Create(SudokuBoard::Empty(side));
+  }
   auto board = std::make_shared<SudokuBoard>(SudokuBoard::Empty(side));
   SudokuMapper mapper(board);
   return mapper.DlInstance();
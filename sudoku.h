@@ -1,9 +1,15 @@
 #pragma once
 
 #include "dancing_links.hpp"
+#include <iosfwd>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace sudoku {
@@ -17,11 +23,36 @@ private:
 
 public:
   static SudokuBoard FromString(const std::string &example);
+  /**
+   * Like FromString, but for untrusted input.
+   * @return nothing if the text is not a board with a square side, or has
+   * numbers out of range
+   */
+  static std::optional<SudokuBoard> Parse(const std::string &example);
   static SudokuBoard Empty(unsigned side);
+  /**
+   * Board with given values, row by row, -1 for empty cells. Filled cells are
+   * predefined.
+   */
+  static SudokuBoard FromValues(unsigned side, const std::vector<int> &vals);
 
   void Set(unsigned int r, unsigned c, unsigned n);
   int Get(unsigned r, unsigned c) const;
   void Print(bool ignore_colors = false);
+  /**
+   * Board in a single line, readable by FromString. Digits for sides up to 9,
+   * "|" followed by space separated numbers for bigger ones.
+   */
+  std::string ToString() const;
+  /**
+   * Fill cells forced by naked singles (one candidate left in the cell) and
+   * hidden singles (one place left for a number in a row, column or box),
+   * until none is left. Boards of side over 64 are left as they are.
+   * @return false if the board has no solution: a number given twice in a
+   * row, column or box, a cell without candidates or a number without place
+   */
+  bool Propagate();
+  bool IsComplete() const;
 
   unsigned GetSide() const { return side; }
   bool IsPredefined(unsigned r, unsigned c) const {
@@ -39,19 +70,41 @@ public:
   SudokuMapper(std::shared_ptr<SudokuBoard> board);
 
   std::unique_ptr<DancingLinks::DLSolver> DlInstance();
+  std::unique_ptr<DancingLinks::BitsetSolver> BitsetInstance();
+  /**
+   * Solve the board in place. Cells forced by SudokuBoard::Propagate are
+   * filled first, the rest is solved with bitsets up to BITSET_MAX_SIDE and
+   * dancing links above. Bitset instances share the matrix of the template,
+   * so they are much cheaper to create, which dominates for easy puzzles;
+   * long searches are faster with dancing links.
+   * @param limits limits of the search, the board is left partially filled
+   * when they are reached
+   * @return Aborted if a limit was reached before the search finished
+   */
+  DancingLinks::SearchStatus
+  Solve(const DancingLinks::SearchLimits &limits = {});
   void RevMap(const std::vector<int> &solution);
 
-private:
-  struct Coord {
-    unsigned r, c, n;
-    Coord() {}
-    Coord(unsigned r, unsigned c, unsigned n) : r(r), c(c), n(n) {}
-  };
+  static constexpr unsigned BITSET_MAX_SIDE = 9;
+  /**
+   * DlInstance builds only rows and columns not excluded by filled cells for
+   * boards of that side and bigger. Below it copying the template of the
+   * empty board is faster, for side 9 the one of FixedSudokuSolver.
+   */
+  static constexpr unsigned RESIDUAL_MIN_SIDE = 16;
+
+  /**
+   * Matrix of the empty board of given side, built once per side and shared.
+   * It is never modified, so copies can be made concurrently from any thread.
+   */
+  static const DancingLinks::DLSolver &EmptyBoardTemplate(unsigned side);
 
+private:
   struct Mapping {
     unsigned r, c, n, side;
 
     Mapping(unsigned r, unsigned c, unsigned n, unsigned side);
+    static Mapping FromRow(unsigned row, unsigned side);
     unsigned Row() const;
     unsigned ColumnCol() const;
     unsigned RowCol() const;
@@ -59,12 +112,205 @@ private:
     unsigned IntersectionCol() const;
   };
 
-  void Populate(DancingLinks::DLSolver *solver);
+  template <typename Solver> static const Solver &CachedTemplate(unsigned side);
+  template <typename Solver> std::unique_ptr<Solver> Instance();
+  /**
+   * Matrix of the board built from scratch: rows only for candidates not
+   * excluded by filled cells and only the columns still open. Row ids are
+   * the same as in the full matrix.
+   */
+  template <typename Solver> std::unique_ptr<Solver> ResidualInstance();
+  template <typename Solver> static void Populate(Solver *solver, unsigned side);
 
-  std::map<unsigned, Coord> dl_row_to_sudoku_field;
   std::shared_ptr<SudokuBoard> board;
 };
 
+/**
+ * Solver of boards with the side known at compile time, instantiated for
+ * sides 9 and 16; the matrix of side 25 exceeds the default constexpr limits
+ * of the compilers. The matrix of the empty board is built by the compiler
+ * and kept in read-only data, so Create only copies it and deletes the rows
+ * of filled cells. Row ids are the same as in SudokuMapper.
+ */
+template <unsigned SIDE> class FixedSudokuSolver final {
+public:
+  static constexpr unsigned N_ROWS = SIDE * SIDE * SIDE;
+  static constexpr unsigned N_COLS = 4 * SIDE * SIDE;
+
+  static std::unique_ptr<DancingLinks::DLSolver>
+  Create(const SudokuBoard &board);
+};
+
+extern template class FixedSudokuSolver<9>;
+extern template class FixedSudokuSolver<16>;
+
+/**
+ * Generator of puzzles with a unique solution. A random solved grid is found
+ * by searching a shuffled matrix of the empty board, then clues are removed
+ * in random order as long as the solution stays unique. The matrix of the
+ * empty board is built once, uniqueness checks assume the clues on it and
+ * stop at the second solution. A check running out of its node budget keeps
+ * the clue, so the solution stays unique but such a puzzle may not be
+ * minimal: some clue left may be not needed. Without aborted checks every
+ * clue left is needed.
+ */
+class SudokuGenerator final {
+public:
+  // search nodes of one uniqueness check. 9x9 checks finish well within it,
+  // a few 16x16 ones and most 25x25 ones give up.
+  static constexpr uint64_t DEFAULT_CHECK_NODES = 100000;
+
+  /**
+   * @param side side of the boards, a square
+   * @param seed same seed gives the same puzzles
+   * @param check_nodes node budget of every uniqueness check, 0 for none
+   */
+  SudokuGenerator(unsigned side, uint64_t seed,
+                  uint64_t check_nodes = DEFAULT_CHECK_NODES);
+
+  /**
+   * Random solved board.
+   * @return nothing if the search found no solved board, which only the
+   * matrix of a side not a square can lack
+   */
+  std::optional<SudokuBoard> Solved();
+  /**
+   * Random puzzle with a unique solution.
+   * @return nothing when Solved returns nothing
+   */
+  std::optional<SudokuBoard> Generate();
+
+  // uniqueness checks done by DLX so far, the others were decided by
+  // SudokuBoard::Propagate.
+  uint64_t SearchChecks() const { return search_checks; }
+  // uniqueness checks given up, their clues were kept.
+  uint64_t AbortedChecks() const { return aborted_checks; }
+
+private:
+  bool Unique(const std::vector<int> &vals);
+
+  unsigned side;
+  std::mt19937_64 rng;
+  // matrix of the empty board, clues are assumed on it and retracted.
+  DancingLinks::DLSolver matrix;
+  uint64_t check_nodes;
+  uint64_t search_checks = 0, aborted_checks = 0;
+};
+
+/**
+ * Transformation keeping the rules of sudoku: transposition, permutations of
+ * bands, of stacks, of rows within a band and of columns within a stack, and
+ * relabeling of the numbers.
+ */
+class SudokuSymmetry final {
+public:
+  /**
+   * Transformation of the board into the canonical form of all boards
+   * equivalent to it, the least of them when read row by row with empty
+   * cells before numbers. Numbers are labeled in order of their first
+   * appearance, so the canonical form doesn't depend on them.
+   * @return nothing if telling the equivalent boards apart takes too long,
+   * e.g. for almost empty boards, and for sides over 64
+   */
+  static std::optional<SudokuSymmetry> Canonicalize(const SudokuBoard &board);
+
+  SudokuBoard Apply(const SudokuBoard &board) const;
+  // Board which Apply transforms into the given one.
+  SudokuBoard Invert(const SudokuBoard &board) const;
+
+private:
+  SudokuSymmetry() = default;
+
+  // the board is transposed first, then row r of the result is row rows[r]
+  // of it and column c its column cols[c].
+  bool transposed = false;
+  std::vector<unsigned> rows, cols;
+  // number of the result for every number of the board.
+  std::vector<int> numbers;
+};
+
+/**
+ * Solutions of boards solved recently, by canonical form, so a board
+ * equivalent to one solved before is not solved again: its solution is
+ * mapped back from the canonical one. At most capacity boards are kept, the
+ * least recently used one is dropped. Safe to use from many threads.
+ */
+class SudokuSolutionCache final {
+public:
+  explicit SudokuSolutionCache(size_t capacity);
+
+  /**
+   * Solve the board in place like SudokuMapper::Solve, or from the cache.
+   * Boards without canonical form are solved, but not cached, nor are
+   * aborted searches.
+   */
+  DancingLinks::SearchStatus
+  Solve(std::shared_ptr<SudokuBoard> board,
+        const DancingLinks::SearchLimits &limits = {});
+
+  uint64_t Hits() const;
+  uint64_t Misses() const;
+
+private:
+  struct Entry {
+    std::string key;
+    DancingLinks::SearchStatus status;
+    // canonical solution, empty unless solved.
+    std::vector<int> solution;
+  };
+
+  size_t capacity;
+  mutable std::mutex mutex;
+  // most recently used first.
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  uint64_t hits = 0, misses = 0;
+};
+
+/**
+ * Solver of puzzles given one per line, used by sudoku_batch. Puzzles are
+ * solved by a pool of threads and the results written in the input order.
+ */
+class SudokuBatch final {
+public:
+  // Limits of every puzzle, 0 means no limit.
+  struct Limits {
+    unsigned milliseconds = 0;
+    uint64_t nodes = 0;
+  };
+
+  // workers solving the puzzles, at least 1, without limits nor cache.
+  explicit SudokuBatch(unsigned n_threads);
+  /**
+   * @param cache optional, every puzzle is solved when null
+   */
+  SudokuBatch(unsigned n_threads, const Limits &limits,
+              SudokuSolutionCache *cache = nullptr);
+
+  /**
+   * Solve the puzzles of in and write a line for every one to out, in the
+   * input order: the solved board, INVALID, NO ANSWER or ABORTED. Blank lines
+   * and lines starting with # are skipped.
+   * @return time spent on every puzzle in microseconds, sorted
+   */
+  std::vector<double> Run(std::istream &in, std::ostream &out) const;
+  // result line of one puzzle.
+  std::string Solve(const std::string &line) const;
+
+  static bool IsPuzzle(const std::string &line);
+  /**
+   * Nearest rank percentile of sorted samples.
+   * @param p from 0 to 100, clamped
+   * @return 0 without samples
+   */
+  static double Percentile(const std::vector<double> &sorted, double p);
+
+private:
+  unsigned n_threads;
+  Limits limits;
+  SudokuSolutionCache *cache;
+};
+
 std::unique_ptr<DancingLinks::DLSolver>
 CreateSudokuSolver(const std::string &puzzle);
 std::unique_ptr<DancingLinks::DLSolver> CreateEmptySudokuSolver(unsigned side);
@@ -0,0 +1,92 @@
+#include "sudoku.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <thread>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using namespace sudoku;
+
+namespace {
+
+void Usage(const char *name) {
+  cerr << "Usage: " << name
+       << " [-j threads] [-t milliseconds] [-n nodes] [-c entries] [file]"
+       << endl;
+  cerr << "Solves puzzles given one per line, from file or standard input."
+       << endl;
+  cerr << "Puzzles not solved within the time or search node limit are "
+          "reported as ABORTED."
+       << endl;
+  cerr << "With -c the solutions of that many recent puzzles are kept, a "
+          "puzzle equivalent to one of them under the symmetries of sudoku "
+          "is not solved again."
+       << endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned n_threads = std::max(1u, std::thread::hardware_concurrency());
+  const char *path = nullptr;
+  SudokuBatch::Limits limits;
+  size_t cache_entries = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      n_threads = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      limits.milliseconds = std::max(0, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      limits.nodes = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      cache_entries = std::strtoull(argv[++i], nullptr, 10);
+    } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+      Usage(argv[0]);
+      return 1;
+    } else {
+      path = argv[i];
+    }
+  }
+
+  std::ifstream file;
+  if (path) {
+    file.open(path);
+    if (!file) {
+      cerr << "Can't open " << path << endl;
+      return 1;
+    }
+  }
+  std::istream &in = path ? file : std::cin;
+
+  std::optional<SudokuSolutionCache> cache;
+  if (cache_entries > 0) {
+    cache.emplace(cache_entries);
+  }
+  SudokuBatch batch(n_threads, limits, cache ? &*cache : nullptr);
+
+  auto t_start = steady_clock::now();
+  auto all = batch.Run(in, cout);
+  cout.flush();
+  double seconds = duration<double>(steady_clock::now() - t_start).count();
+
+  cerr << all.size() << " puzzles in " << seconds << " s, "
+       << (seconds > 0 ? all.size() / seconds : 0) << " puzzles/s, "
+       << n_threads << " threads" << endl;
+  cerr << "latency (microseconds): p50 " << SudokuBatch::Percentile(all, 50)
+       << ", p90 " << SudokuBatch::Percentile(all, 90) << ", p99 "
+       << SudokuBatch::Percentile(all, 99) << ", max "
+       << SudokuBatch::Percentile(all, 100) << endl;
+  if (cache) {
+    cerr << "cache hits " << cache->Hits() << ", misses " << cache->Misses()
+         << endl;
+  }
+  return 0;
+}
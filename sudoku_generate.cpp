@@ -0,0 +1,137 @@
+#include "sudoku.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using namespace sudoku;
+
+namespace {
+
+void Usage(const char *name) {
+  cerr << "Usage: " << name
+       << " [-s side] [-n count] [-j threads] [-r seed] [-b nodes]" << endl;
+  cerr << "Writes puzzles with a unique solution, one per line." << endl;
+  cerr << "Worker i uses seed + i, so the output depends only on the seed "
+          "and the number of threads."
+       << endl;
+  cerr << "A uniqueness check searching more than -b nodes (default "
+       << SudokuGenerator::DEFAULT_CHECK_NODES
+       << ", 0 for no limit) keeps its clue, so the puzzle may not be minimal."
+       << endl;
+}
+
+unsigned Clues(const SudokuBoard &board) {
+  unsigned clues = 0;
+  for (unsigned r = 0; r < board.GetSide(); r++) {
+    for (unsigned c = 0; c < board.GetSide(); c++) {
+      clues += board.Get(r, c) >= 0;
+    }
+  }
+  return clues;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned side = 9, count = 1;
+  unsigned n_threads = std::max(1u, std::thread::hardware_concurrency());
+  uint64_t seed = 0, check_nodes = SudokuGenerator::DEFAULT_CHECK_NODES;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      side = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      count = std::max(0, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      n_threads = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      check_nodes = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  unsigned box_size = 1;
+  while ((box_size + 1) * (box_size + 1) <= side) {
+    box_size++;
+  }
+  if (box_size * box_size != side || side > 64) {
+    cerr << "Side has to be a square, at most 64" << endl;
+    return 1;
+  }
+  n_threads = std::min(n_threads, std::max(1u, count));
+
+  // worker i makes puzzles i, i + n_threads, ...
+  vector<vector<std::string>> puzzles(n_threads);
+  vector<uint64_t> clues(n_threads, 0), checks(n_threads, 0),
+      aborted(n_threads, 0);
+
+  std::atomic<bool> failed = false;
+
+  auto work = [&](unsigned worker) {
+    SudokuGenerator generator(side, seed + worker, check_nodes);
+    for (unsigned i = worker; i < count && !failed; i += n_threads) {
+      auto puzzle = generator.Generate();
+      if (!puzzle) {
+        failed = true;
+        break;
+      }
+      clues[worker] += Clues(*puzzle);
+      puzzles[worker].push_back(puzzle->ToString());
+    }
+    checks[worker] = generator.SearchChecks();
+    aborted[worker] = generator.AbortedChecks();
+  };
+
+  auto t_start = steady_clock::now();
+  vector<std::thread> workers;
+  for (unsigned i = 0; i < n_threads; i++) {
+    workers.emplace_back(work, i);
+  }
+  for (auto &t : workers) {
+    t.join();
+  }
+  double seconds = duration<double>(steady_clock::now() - t_start).count();
+  if (failed) {
+    cerr << "No solved board of side " << side << " found" << endl;
+    return 1;
+  }
+
+  for (unsigned i = 0; i < count; i++) {
+    cout << puzzles[i % n_threads][i / n_threads] << '\n';
+  }
+  cout.flush();
+
+  uint64_t total_clues = 0, total_checks = 0, total_aborted = 0;
+  for (unsigned i = 0; i < n_threads; i++) {
+    total_clues += clues[i];
+    total_checks += checks[i];
+    total_aborted += aborted[i];
+  }
+  cerr << count << " puzzles in " << seconds << " s, "
+       << (seconds > 0 ? count / seconds : 0) << " puzzles/s, " << n_threads
+       << " threads" << endl;
+  cerr << "clues per puzzle " << (count ? (double)total_clues / count : 0)
+       << ", searches per puzzle "
+       << (count ? (double)total_checks / count : 0) << endl;
+  if (total_aborted > 0) {
+    cerr << total_aborted
+         << " searches gave up, their clues were kept: those puzzles may not "
+            "be minimal"
+         << endl;
+  }
+  return 0;
+}
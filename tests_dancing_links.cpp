@@ -2,11 +2,20 @@
 // Created by piotr on 02.05.17.
 //
 
+#include <algorithm>
+#include <array>
 #include <bitset>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <set>
+#include <stop_token>
 
 #include <gtest/gtest.h>
 
 #include "dancing_links.hpp"
+#include "matrix_file.hpp"
 
 using namespace DancingLinks;
 using namespace DancingLinks::Internal;
@@ -16,9 +25,9 @@ using namespace std;
 const unsigned COLS = 7;
 typedef std::bitset<COLS> B7;
 
-class TestDancingLinks : public ::testing::Test {
+template <typename Solver> class TestDancingLinks : public ::testing::Test {
 protected:
-  DancingLinks::DLSolver *dl = nullptr;
+  Solver *dl = nullptr;
 
   std::vector<B7> hardcoded1 = std::vector<B7>{
       B7("1010000"), B7("0100000"), B7("0001101"), B7("0011001"), B7("0000010"),
@@ -47,7 +56,7 @@ protected:
   }
 
   void PopulateDl(const std::vector<B7> &data) {
-    dl = new DancingLinks::DLSolver(data.size(), COLS);
+    dl = new Solver(data.size(), COLS);
 
     for (unsigned r = 0; r < data.size(); r++) {
       for (unsigned c = 0; c < COLS; c++) {
@@ -57,57 +66,262 @@ protected:
       }
     }
   }
+
+  static const unsigned N = 4;
+
+  // Latin squares of order N: row (r, c, n) covers cell, row-digit and
+  // column-digit constraints.
+  template <typename S = Solver> static std::unique_ptr<S> LatinSquare() {
+    auto ret = std::make_unique<S>(N * N * N, 3 * N * N);
+    for (unsigned r = 0; r < N; r++) {
+      for (unsigned c = 0; c < N; c++) {
+        for (unsigned n = 0; n < N; n++) {
+          unsigned row = (r * N + c) * N + n;
+          ret->Add(row, r * N + c);
+          ret->Add(row, N * N + r * N + n);
+          ret->Add(row, 2 * N * N + c * N + n);
+        }
+      }
+    }
+    return ret;
+  }
 };
 
-TEST_F(TestDancingLinks, AllRowsCoverDistinctColumnsWhenRunOnSimpleExample) {
-  PopulateDl(hardcoded1);
+struct BucketPolicy : DefaultPolicy {
+  static constexpr bool BUCKET_COLUMNS = true;
+};
 
-  auto solution = dl->Solve();
+struct StatsPolicy : DefaultPolicy {
+  static constexpr bool STATS = true;
+};
+
+struct ColorPolicy : DefaultPolicy {
+  static constexpr bool COLORS = true;
+};
+
+struct BucketColorPolicy : BucketPolicy {
+  static constexpr bool COLORS = true;
+};
+
+struct MultiplicityPolicy : DefaultPolicy {
+  static constexpr bool MULTIPLICITY = true;
+};
+
+struct MultiplicityColorPolicy : MultiplicityPolicy {
+  static constexpr bool COLORS = true;
+};
+
+using Solvers = ::testing::Types<DLSolver, BasicDLSolver<BucketPolicy>,
+                                 BitsetSolver, LinkedDLSolver>;
+TYPED_TEST_SUITE(TestDancingLinks, Solvers);
+
+TYPED_TEST(TestDancingLinks, AllRowsCoverDistinctColumnsWhenRunOnSimpleExample) {
+  this->PopulateDl(this->hardcoded1);
+
+  auto solution = this->dl->Solve();
   auto cols = B7();
 
   for (auto row : solution) {
-    auto covered = hardcoded1[row];
+    auto covered = this->hardcoded1[row];
     EXPECT_FALSE((cols & covered).any());
     cols |= covered;
   }
 }
 
-TEST_F(TestDancingLinks, AllColumnsCoveredWhenRunOnSimpleExample) {
-  PopulateDl(hardcoded1);
+TYPED_TEST(TestDancingLinks, AllColumnsCoveredWhenRunOnSimpleExample) {
+  this->PopulateDl(this->hardcoded1);
 
-  auto solution = dl->Solve();
+  auto solution = this->dl->Solve();
   auto cols = B7();
 
   for (auto row : solution) {
-    cols |= hardcoded1[row];
+    cols |= this->hardcoded1[row];
   }
 
   EXPECT_TRUE(cols.all());
 }
 
-TEST_F(TestDancingLinks, EmptySolutionWhenCantCoverColumn) {
-  PopulateDl(impossible_column_3);
-  auto solution = dl->Solve();
+TYPED_TEST(TestDancingLinks, EmptySolutionWhenCantCoverColumn) {
+  this->PopulateDl(this->impossible_column_3);
+  auto solution = this->dl->Solve();
   EXPECT_EQ(solution.size(), 0uz);
 }
 
-TEST_F(TestDancingLinks, EmptySolutionWhenAllRowsInConflict) {
-  PopulateDl(no_feasible_subset);
-  auto solution = dl->Solve();
+TYPED_TEST(TestDancingLinks, EmptySolutionWhenAllRowsInConflict) {
+  this->PopulateDl(this->no_feasible_subset);
+  auto solution = this->dl->Solve();
   EXPECT_EQ(solution.size(), 0uz);
 }
 
-TEST_F(TestDancingLinks, CorrectAnswerWhenMoreRowsDeclaredThanUsed) {
-  dl = new DancingLinks::DLSolver(100, COLS);
+TYPED_TEST(TestDancingLinks, CorrectAnswerWhenMoreRowsDeclaredThanUsed) {
+  this->dl = new TypeParam(100, COLS);
 
-  for (unsigned r = 0; r < hardcoded1.size(); r++) {
+  for (unsigned r = 0; r < this->hardcoded1.size(); r++) {
     for (unsigned c = 0; c < COLS; c++) {
-      if (hardcoded1[r][c]) {
-        dl->Add(r, c);
+      if (this->hardcoded1[r][c]) {
+        this->dl->Add(r, c);
+      }
+    }
+  }
+
+  auto solution = this->dl->Solve();
+  auto cols = B7();
+
+  for (auto row : solution) {
+    cols |= this->hardcoded1[row];
+  }
+
+  EXPECT_TRUE(cols.all());
+}
+
+TYPED_TEST(TestDancingLinks, CorrectAnswerWhenRowsAddedOutOfOrder) {
+  this->dl = new TypeParam(this->hardcoded1.size(), COLS);
+
+  // add columns from the last one, so that rows are interleaved.
+  for (int c = COLS - 1; c >= 0; c--) {
+    for (unsigned r = 0; r < this->hardcoded1.size(); r++) {
+      if (this->hardcoded1[r][c]) {
+        this->dl->Add(r, c);
+      }
+    }
+  }
+
+  auto solution = this->dl->Solve();
+  auto cols = B7();
+
+  for (auto row : solution) {
+    auto covered = this->hardcoded1[row];
+    EXPECT_FALSE((cols & covered).any());
+    cols |= covered;
+  }
+
+  EXPECT_TRUE(cols.all());
+}
+
+TYPED_TEST(TestDancingLinks, RemainingColumnsCoveredWhenRowDeleted) {
+  this->PopulateDl(this->hardcoded1);
+
+  this->dl->DeleteRow(0);
+  auto solution = this->dl->Solve();
+  auto cols = this->hardcoded1[0];
+
+  for (auto row : solution) {
+    auto covered = this->hardcoded1[row];
+    EXPECT_FALSE((cols & covered).any());
+    cols |= covered;
+  }
+
+  EXPECT_TRUE(cols.all());
+}
+
+TEST(TestDLSolver, AllColumnsCoveredWhenSearchIsDeep) {
+  // every column has its own row, so each one takes a separate level.
+  const unsigned n = 5000;
+  DLSolver solver(n, n);
+  for (unsigned i = 0; i < n; i++) {
+    solver.Add(i, i);
+  }
+
+  auto solution = solver.Solve();
+  std::vector<bool> used(n, false);
+  for (auto row : solution) {
+    used[row] = true;
+  }
+
+  EXPECT_EQ(solution.size(), n);
+  EXPECT_EQ(std::count(begin(used), end(used), true), n);
+}
+
+TEST(TestDLSolver, SameSolutionWhenSolvedTwice) {
+  DLSolver solver(4, 3);
+  solver.Add(0, 0);
+  solver.Add(1, 1);
+  solver.Add(1, 2);
+  solver.Add(2, 0);
+  solver.Add(2, 1);
+  solver.Add(3, 2);
+
+  auto first = solver.Solve();
+  auto second = solver.Solve();
+
+  EXPECT_EQ(first.size(), 2uz);
+  EXPECT_EQ(first, second);
+}
+
+TEST(TestDLSolver, RowsLaidOutOnceWhenAddedColumnByColumn) {
+  // Latin squares of order 4, as in TestDLSolverParallel, and two rows with
+  // all columns, added in the order of columns.
+  const unsigned n = 4, wide = 2000;
+  DLSolver by_rows(n * n * n, 3 * n * n), by_cols(n * n * n, 3 * n * n);
+  auto row_columns = [&](unsigned row) {
+    unsigned r = row / (n * n), c = row / n % n, d = row % n;
+    return std::array<unsigned, 3>{r * n + c, n * n + r * n + d,
+                                   2 * n * n + c * n + d};
+  };
+  for (unsigned row = 0; row < n * n * n; row++) {
+    for (unsigned col : row_columns(row)) {
+      by_rows.Add(row, col);
+    }
+  }
+  for (unsigned col = 0; col < 3 * n * n; col++) {
+    for (unsigned row = 0; row < n * n * n; row++) {
+      if (std::ranges::count(row_columns(row), col) != 0) {
+        by_cols.Add(row, col);
       }
     }
   }
+  DLSolver two(2, wide);
+  for (unsigned col = 0; col < wide; col++) {
+    two.Add(0, col);
+    two.Add(1, col);
+  }
+
+  EXPECT_EQ(by_cols.Count(), 576u);
+  EXPECT_EQ(two.Count(), 2u);
+  // every row is moved at most once, leaving its first one and spacer
+  // behind, besides the headers and the ones of both rows.
+  EXPECT_LE(by_cols.NodeCount(), by_rows.NodeCount() + 2 * n * n * n);
+  EXPECT_LE(two.NodeCount(), (wide + 2) + 2 * wide + 3 + 2 * 2);
+}
 
+class TestDLSolverSearch : public TestDancingLinks<DLSolver> {
+protected:
+  uint64_t BruteForceCount(const std::vector<B7> &data) {
+    uint64_t found = 0;
+    for (unsigned subset = 0; subset < (1u << data.size()); subset++) {
+      auto cols = B7();
+      bool disjoint = true;
+      for (unsigned r = 0; r < data.size(); r++) {
+        if (subset & (1u << r)) {
+          disjoint = disjoint && !(cols & data[r]).any();
+          cols |= data[r];
+        }
+      }
+      found += disjoint && cols.all();
+    }
+    return found;
+  }
+};
+
+TEST_F(TestDLSolverSearch, CountMatchesBruteForceWhenNoLimit) {
+  PopulateDl(hardcoded1);
+  EXPECT_EQ(dl->Count(), BruteForceCount(hardcoded1));
+}
+
+TEST_F(TestDLSolverSearch, CountStopsAtLimit) {
+  PopulateDl(hardcoded1);
+  ASSERT_GT(BruteForceCount(hardcoded1), 1u);
+  EXPECT_EQ(dl->Count(1), 1u);
+}
+
+TEST_F(TestDLSolverSearch, ZeroWhenNoSolution) {
+  PopulateDl(no_feasible_subset);
+  EXPECT_EQ(dl->Count(2), 0u);
+}
+
+TEST_F(TestDLSolverSearch, SolveWorksAfterCount) {
+  PopulateDl(hardcoded1);
+  dl->Count(1);
   auto solution = dl->Solve();
   auto cols = B7();
 
@@ -117,3 +331,796 @@ TEST_F(TestDancingLinks, CorrectAnswerWhenMoreRowsDeclaredThanUsed) {
 
   EXPECT_TRUE(cols.all());
 }
+
+TEST_F(TestDLSolverSearch, AllSolutionsEnumeratedOnce) {
+  PopulateDl(hardcoded1);
+
+  std::set<std::vector<int>> seen;
+  for (auto rows : dl->Solutions()) {
+    auto cols = B7();
+    for (auto row : rows) {
+      EXPECT_FALSE((cols & hardcoded1[row]).any());
+      cols |= hardcoded1[row];
+    }
+    EXPECT_TRUE(cols.all());
+
+    std::vector<int> sorted(rows.begin(), rows.end());
+    std::sort(begin(sorted), end(sorted));
+    EXPECT_TRUE(seen.insert(sorted).second);
+  }
+
+  EXPECT_EQ(seen.size(), BruteForceCount(hardcoded1));
+}
+
+TEST_F(TestDLSolverSearch, SolveWorksAfterEnumerationStopped) {
+  PopulateDl(hardcoded1);
+
+  for (auto rows : dl->Solutions()) {
+    EXPECT_FALSE(rows.empty());
+    break;
+  }
+
+  EXPECT_EQ(dl->Count(), BruteForceCount(hardcoded1));
+}
+
+class TestDLSolverAssume : public TestDancingLinks<DLSolver> {};
+
+TEST_F(TestDLSolverAssume, AssumedRowCountedLikeDeletedOne) {
+  PopulateDl(hardcoded1);
+  auto total = dl->Count();
+
+  for (unsigned r = 0; r < hardcoded1.size(); r++) {
+    DLSolver deleted(*dl);
+    deleted.DeleteRow(r);
+
+    ASSERT_TRUE(dl->Assume(r));
+    EXPECT_EQ(dl->Count(), deleted.Count());
+    dl->Retract();
+    EXPECT_EQ(dl->Count(), total);
+  }
+}
+
+TEST_F(TestDLSolverAssume, ConflictingRowNotAssumed) {
+  PopulateDl(hardcoded1);
+  ASSERT_TRUE((hardcoded1[0] & hardcoded1[5]).any());
+
+  ASSERT_TRUE(dl->Assume(0));
+  EXPECT_FALSE(dl->Assume(5));
+  EXPECT_EQ(dl->Assumed(), 1u);
+  dl->Retract();
+  EXPECT_TRUE(dl->Assume(5));
+}
+
+TEST_F(TestDLSolverAssume, AssumptionsRetractedInReverseOrder) {
+  auto dl = LatinSquare();
+  // first row of the square fixed to 0 1 2 3, then undone digit by digit.
+  std::vector<uint64_t> counts{dl->Count()};
+  for (unsigned c = 0; c < N; c++) {
+    ASSERT_TRUE(dl->Assume(c * N + c));
+    counts.push_back(dl->Count());
+  }
+  EXPECT_EQ(counts, (std::vector<uint64_t>{576, 144, 48, 24, 24}));
+  EXPECT_EQ(dl->ParallelCount(3), 24u);
+  // the fixed cells are not part of the solution.
+  EXPECT_EQ(dl->Solve().size(), N * N - N);
+
+  for (unsigned c = N; c-- > 0;) {
+    dl->Retract();
+    EXPECT_EQ(dl->Count(), counts[c]);
+  }
+  EXPECT_EQ(dl->Assumed(), 0u);
+}
+
+TEST_F(TestDLSolverAssume, AssumptionsKeptByShuffledSearches) {
+  auto dl = LatinSquare();
+  // cells 0 and 1 of the first row fixed, so their rows 0 to 2N - 1 are out.
+  ASSERT_TRUE(dl->Assume(0));
+  ASSERT_TRUE(dl->Assume(N + 1));
+  auto excludes_fixed = [](const std::vector<int> &solution) {
+    return solution.size() == N * N - 2 &&
+           std::ranges::all_of(solution, [](int r) { return r >= 2 * (int)N; });
+  };
+
+  dl->Shuffle(7);
+  EXPECT_EQ(dl->Count(), 48u);
+  auto result = dl->RestartSolve(3, 1);
+  ASSERT_EQ(result.status, SearchStatus::Solved);
+  EXPECT_TRUE(excludes_fixed(result.rows));
+  EXPECT_TRUE(excludes_fixed(dl->PortfolioSolve(4, 5)));
+  EXPECT_EQ(dl->Count(), 48u);
+  EXPECT_EQ(dl->Assumed(), 2u);
+
+  dl->Retract();
+  EXPECT_EQ(dl->Count(), 144u);
+  dl->Retract();
+  EXPECT_EQ(dl->Count(), 576u);
+}
+
+class TestDLSolverParallel : public TestDancingLinks<DLSolver> {};
+
+TEST_F(TestDLSolverParallel, ParallelCountMatchesCount) {
+  auto dl = LatinSquare();
+  auto expected = dl->Count();
+
+  EXPECT_EQ(expected, 576u);
+  EXPECT_EQ(dl->ParallelCount(4), expected);
+  EXPECT_EQ(dl->ParallelCount(1), expected);
+}
+
+TEST_F(TestDLSolverParallel, ParallelCountStopsAtLimit) {
+  auto dl = LatinSquare();
+  EXPECT_EQ(dl->ParallelCount(4, 10), 10u);
+}
+
+TEST_F(TestDLSolverParallel, AllSolutionsEnumeratedOnceByWorkers) {
+  auto dl = LatinSquare();
+  const unsigned workers = 3;
+
+  std::vector<std::set<std::vector<int>>> seen(workers);
+  dl->ParallelSolutions(workers, [&](unsigned worker, std::span<const int> rows) {
+    std::vector<int> sorted(rows.begin(), rows.end());
+    std::sort(begin(sorted), end(sorted));
+    EXPECT_EQ(sorted.size(), N * N);
+    seen[worker].insert(sorted);
+  });
+
+  std::set<std::vector<int>> all;
+  size_t total = 0;
+  for (auto &s : seen) {
+    total += s.size();
+    all.insert(begin(s), end(s));
+  }
+  EXPECT_EQ(total, 576u);
+  EXPECT_EQ(all.size(), 576u);
+}
+
+TEST_F(TestDLSolverParallel, SameCountWhenColumnsBucketed) {
+  auto dl = LatinSquare<BasicDLSolver<BucketPolicy>>();
+
+  EXPECT_EQ(dl->Count(), 576u);
+  dl->Shuffle(3);
+  EXPECT_EQ(dl->Count(), 576u);
+  EXPECT_EQ(dl->ParallelCount(2), 576u);
+}
+
+TEST_F(TestDLSolverParallel, SameCountWhenSolvedWithBitsets) {
+  auto dl = LatinSquare<BitsetSolver>();
+
+  EXPECT_EQ(dl->Count(), 576u);
+  EXPECT_EQ(dl->Count(5), 5u);
+  EXPECT_EQ(dl->Solve().size(), N * N);
+}
+
+TEST_F(TestDLSolverParallel, SameCountWhenShuffled) {
+  auto dl = LatinSquare();
+  dl->Shuffle(7);
+  EXPECT_EQ(dl->Count(), 576u);
+}
+
+TEST_F(TestDLSolverParallel, StatsCountEveryRowTried) {
+  auto dl = LatinSquare<BasicDLSolver<StatsPolicy>>();
+
+  EXPECT_EQ(dl->Count(), 576u);
+  const SearchStats stats = dl->Stats();
+  uint64_t branches = 0;
+  for (size_t k = 0; k < stats.branching.size(); k++) {
+    branches += k * stats.branching[k];
+  }
+  // every row of every chosen column is tried, the last one ends a solution.
+  EXPECT_EQ(stats.TotalNodes(), branches);
+  ASSERT_EQ(stats.nodes.size(), N * N);
+  EXPECT_EQ(stats.nodes[N * N - 1], 576u);
+  // all links are restored after the search.
+  EXPECT_GT(stats.updates, 0u);
+  EXPECT_EQ(stats.updates % 2, 0u);
+  EXPECT_GT(stats.mems, stats.updates);
+
+  // workers add up to the serial search, the levels split among them are
+  // counted once.
+  for (unsigned workers : {1u, 3u}) {
+    dl->ResetStats();
+    EXPECT_EQ(dl->ParallelCount(workers), 576u);
+    EXPECT_EQ(dl->Stats().nodes, stats.nodes);
+    EXPECT_EQ(dl->Stats().TotalNodes(), stats.TotalNodes());
+    EXPECT_EQ(dl->Stats().branching, stats.branching);
+    EXPECT_EQ(dl->Stats().updates, stats.updates);
+  }
+}
+
+TEST_F(TestDLSolverParallel, NoStatsByDefault) {
+  auto dl = LatinSquare();
+  dl->Count();
+  EXPECT_EQ(dl->Stats().TotalNodes(), 0u);
+  EXPECT_EQ(dl->Stats().mems, 0u);
+}
+
+class TestDLSolverLimits : public TestDancingLinks<DLSolver> {};
+
+TEST_F(TestDLSolverLimits, AbortedWhenNodeBudgetSpent) {
+  auto dl = LatinSquare();
+  SearchLimits limits;
+  limits.max_nodes = 5;
+
+  auto result = dl->Solve(limits);
+  EXPECT_EQ(result.status, SearchStatus::Aborted);
+  EXPECT_TRUE(result.rows.empty());
+
+  result = dl->Solve(SearchLimits());
+  EXPECT_EQ(result.status, SearchStatus::Solved);
+  EXPECT_EQ(result.rows.size(), N * N);
+  EXPECT_EQ(dl->Solve(), result.rows);
+}
+
+TEST_F(TestDLSolverLimits, AbortedWhenStopRequestedOrPastDeadline) {
+  auto dl = LatinSquare();
+  std::stop_source source;
+  source.request_stop();
+  SearchLimits stopped;
+  stopped.stop = source.get_token();
+  EXPECT_EQ(dl->Solve(stopped).status, SearchStatus::Aborted);
+
+  SearchLimits late;
+  late.deadline = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+  EXPECT_EQ(dl->Solve(late).status, SearchStatus::Aborted);
+  EXPECT_EQ(dl->Count(), 576u);
+}
+
+TEST_F(TestDLSolverLimits, CountAbortedWhenNodeBudgetSpent) {
+  auto dl = LatinSquare();
+  SearchLimits limits;
+  limits.max_nodes = 100;
+
+  auto result = dl->Count(0, limits);
+  EXPECT_EQ(result.status, SearchStatus::Aborted);
+  EXPECT_LT(result.count, 576u);
+
+  result = dl->Count(10, limits);
+  EXPECT_EQ(result.status, SearchStatus::Solved);
+  EXPECT_EQ(result.count, 10u);
+
+  result = dl->Count(0, SearchLimits());
+  EXPECT_EQ(result.status, SearchStatus::Solved);
+  EXPECT_EQ(result.count, 576u);
+  EXPECT_EQ(dl->Count(), 576u);
+}
+
+TEST_F(TestDLSolverLimits, NoSolutionStatusWhenAllRowsInConflict) {
+  PopulateDl(no_feasible_subset);
+  auto result = dl->Solve(SearchLimits());
+  EXPECT_EQ(result.status, SearchStatus::NoSolution);
+  EXPECT_TRUE(result.rows.empty());
+  EXPECT_EQ(dl->Count(0, SearchLimits()).status, SearchStatus::NoSolution);
+}
+
+TEST_F(TestDLSolverLimits, BitsetAbortedWhenNodeBudgetSpent) {
+  auto dl = LatinSquare<BitsetSolver>();
+  SearchLimits limits;
+  limits.max_nodes = 5;
+
+  EXPECT_EQ(dl->Solve(limits).status, SearchStatus::Aborted);
+  EXPECT_EQ(dl->Solve(SearchLimits()).status, SearchStatus::Solved);
+}
+
+class TestDLSolverRestart : public TestDancingLinks<DLSolver> {};
+
+TEST_F(TestDLSolverRestart, RestartSolutionSameForSameSeed) {
+  auto dl = LatinSquare();
+  auto result = dl->RestartSolve(7, 1);
+  ASSERT_EQ(result.status, SearchStatus::Solved);
+  ASSERT_EQ(result.rows.size(), N * N);
+
+  std::set<unsigned> cells;
+  for (int row : result.rows) {
+    cells.insert(row / N);
+  }
+  EXPECT_EQ(cells.size(), N * N);
+
+  auto again = LatinSquare()->RestartSolve(7, 1);
+  EXPECT_EQ(again.rows, result.rows);
+}
+
+TEST_F(TestDLSolverRestart, RestartAbortedWhenNodeBudgetSpent) {
+  auto dl = LatinSquare();
+  SearchLimits limits;
+  limits.max_nodes = 5;
+  EXPECT_EQ(dl->RestartSolve(0, 1, limits).status, SearchStatus::Aborted);
+  EXPECT_EQ(dl->Count(), 576u);
+}
+
+TEST_F(TestDLSolverRestart, RestartNoSolutionWhenAllRowsInConflict) {
+  PopulateDl(no_feasible_subset);
+  EXPECT_EQ(dl->RestartSolve(0, 1).status, SearchStatus::NoSolution);
+}
+
+TEST_F(TestDLSolverParallel, PortfolioSolutionCoversAllColumns) {
+  auto dl = LatinSquare();
+  auto solution = dl->PortfolioSolve(4, 11);
+
+  std::set<int> cells;
+  for (auto row : solution) {
+    cells.insert(row / N);
+  }
+  EXPECT_EQ(solution.size(), N * N);
+  EXPECT_EQ(cells.size(), N * N);
+}
+
+TEST_F(TestDLSolverSearch, PortfolioEmptySolutionWhenAllRowsInConflict) {
+  PopulateDl(no_feasible_subset);
+  EXPECT_EQ(dl->PortfolioSolve(4).size(), 0uz);
+}
+
+TEST(TestDLSolver, AllQueenPlacementsCountedWhenDiagonalsSecondary) {
+  // ranks and files are primary, diagonals are covered at most once.
+  const unsigned n = 8;
+  DLSolver solver(n * n, 2 * n, 2 * (2 * n - 1));
+  for (unsigned r = 0; r < n; r++) {
+    for (unsigned c = 0; c < n; c++) {
+      unsigned row = r * n + c;
+      solver.Add(row, r);
+      solver.Add(row, n + c);
+      solver.Add(row, 2 * n + r + c);
+      solver.Add(row, 2 * n + (2 * n - 1) + (n - 1 - r + c));
+    }
+  }
+
+  EXPECT_EQ(solver.Count(), 92u);
+
+  BitsetSolver bitset(n * n, 2 * n, 2 * (2 * n - 1));
+  for (unsigned r = 0; r < n; r++) {
+    for (unsigned c = 0; c < n; c++) {
+      unsigned row = r * n + c;
+      bitset.Add(row, r);
+      bitset.Add(row, n + c);
+      bitset.Add(row, 2 * n + r + c);
+      bitset.Add(row, 2 * n + (2 * n - 1) + (n - 1 - r + c));
+    }
+  }
+  EXPECT_EQ(bitset.Count(), 92u);
+
+  auto solution = solver.Solve();
+  ASSERT_EQ(solution.size(), n);
+  for (unsigned i = 0; i < n; i++) {
+    for (unsigned j = i + 1; j < n; j++) {
+      int ri = solution[i] / n, ci = solution[i] % n;
+      int rj = solution[j] / n, cj = solution[j] % n;
+      EXPECT_NE(std::abs(ri - rj), std::abs(ci - cj));
+    }
+  }
+}
+
+TEST(TestDLSolver, BitsetCopyUnchangedWhenOriginalModified) {
+  BitsetSolver solver(3, 2);
+  solver.Add(0, 0);
+  solver.Add(1, 1);
+  solver.Prepare();
+
+  BitsetSolver copy(solver);
+  solver.Add(2, 0);
+  solver.Add(2, 1);
+  copy.DeleteRow(0);
+
+  EXPECT_EQ(solver.Count(), 2u);
+  EXPECT_EQ(copy.Count(), 1u);
+  EXPECT_EQ(copy.Solve(), std::vector<int>{1});
+}
+
+TEST(TestDLSolver, BitsetWithoutRowsSolvedLikeDLSolver) {
+  for (unsigned n_cols : {0u, 3u}) {
+    BitsetSolver bitset(0, n_cols);
+    DLSolver dl(0, n_cols);
+
+    EXPECT_EQ(bitset.Count(), dl.Count());
+    EXPECT_EQ(bitset.Solve(), dl.Solve());
+    EXPECT_EQ(bitset.Solve(SearchLimits()).status,
+              dl.Solve(SearchLimits()).status);
+  }
+}
+
+TEST(TestDLSolver, SecondaryColumnMayStayUncovered) {
+  DLSolver solver(2, 1, 1);
+  solver.Add(0, 0);
+  solver.Add(1, 0);
+  solver.Add(1, 1);
+
+  EXPECT_EQ(solver.Count(), 2u);
+}
+
+constexpr unsigned STATIC_QUEENS = 6;
+
+constexpr auto StaticQueens() {
+  const unsigned n = STATIC_QUEENS;
+  StaticMatrix<n * n, 2 * n, 2 * (2 * n - 1), 4 * n * n> matrix;
+  for (unsigned r = 0; r < n; r++) {
+    for (unsigned c = 0; c < n; c++) {
+      unsigned row = r * n + c;
+      matrix.Add(row, r);
+      matrix.Add(row, n + c);
+      matrix.Add(row, 2 * n + r + c);
+      matrix.Add(row, 2 * n + (2 * n - 1) + (n - 1 - r + c));
+    }
+  }
+  return matrix;
+}
+
+TEST(TestDLSolver, StaticMatrixSolvedLikeAddedOne) {
+  static constexpr auto matrix = StaticQueens();
+  const unsigned n = STATIC_QUEENS;
+  DLSolver added(n * n, 2 * n, 2 * (2 * n - 1));
+  for (unsigned r = 0; r < n; r++) {
+    for (unsigned c = 0; c < n; c++) {
+      unsigned row = r * n + c;
+      added.Add(row, r);
+      added.Add(row, n + c);
+      added.Add(row, 2 * n + r + c);
+      added.Add(row, 2 * n + (2 * n - 1) + (n - 1 - r + c));
+    }
+  }
+  DLSolver copied(matrix);
+
+  std::vector<std::vector<int>> expected, actual;
+  for (auto s : added.Solutions()) {
+    expected.emplace_back(begin(s), end(s));
+  }
+  for (auto s : copied.Solutions()) {
+    actual.emplace_back(begin(s), end(s));
+  }
+  EXPECT_EQ(expected.size(), 4u);
+  EXPECT_EQ(actual, expected);
+
+  // rows can still be deleted.
+  copied.DeleteRow(1);
+  added.DeleteRow(1);
+  EXPECT_EQ(copied.Count(), added.Count());
+}
+
+// 6 queens, ranks and files primary, diagonals secondary.
+struct SparseQueens {
+  const unsigned n = 6;
+  std::vector<uint8_t> secondary;
+  std::vector<uint64_t> offsets{0};
+  std::vector<uint32_t> columns;
+
+  // with interleaved, secondary columns are mixed between primary ones.
+  explicit SparseQueens(bool interleaved) {
+    unsigned diagonals = 2 * n - 1;
+    for (unsigned c = 0; c < 2 * n + 2 * diagonals; c++) {
+      secondary.push_back(c >= 2 * n);
+    }
+    if (interleaved) {
+      std::swap(secondary[0], secondary[2 * n]);
+    }
+    for (unsigned r = 0; r < n; r++) {
+      for (unsigned c = 0; c < n; c++) {
+        for (unsigned col : {r, n + c, 2 * n + r + c,
+                             2 * n + diagonals + (n - 1 - r + c)}) {
+          // swapped columns keep their meaning.
+          columns.push_back(interleaved && col == 0        ? 2 * n
+                            : interleaved && col == 2 * n ? 0
+                                                           : col);
+        }
+        offsets.push_back(columns.size());
+      }
+    }
+  }
+
+  SparseRows Rows() const { return {secondary, offsets, columns}; }
+};
+
+std::set<std::vector<int>> AllSolutions(DLSolver &solver) {
+  std::set<std::vector<int>> ret;
+  for (auto s : solver.Solutions()) {
+    std::vector<int> rows(begin(s), end(s));
+    std::sort(begin(rows), end(rows));
+    ret.insert(rows);
+  }
+  return ret;
+}
+
+TEST(TestDLSolver, SparseRowsSolvedLikeAddedOne) {
+  SparseQueens queens(false);
+  DLSolver added(queens.n * queens.n, 2 * queens.n, 2 * (2 * queens.n - 1));
+  for (unsigned r = 0; r < queens.n * queens.n; r++) {
+    for (uint64_t k = queens.offsets[r]; k < queens.offsets[r + 1]; k++) {
+      added.Add(r, queens.columns[k]);
+    }
+  }
+  DLSolver sparse(queens.Rows());
+
+  std::vector<std::vector<int>> expected, actual;
+  for (auto s : added.Solutions()) {
+    expected.emplace_back(begin(s), end(s));
+  }
+  for (auto s : sparse.Solutions()) {
+    actual.emplace_back(begin(s), end(s));
+  }
+  EXPECT_EQ(expected.size(), 4u);
+  EXPECT_EQ(actual, expected);
+
+  SparseQueens interleaved(true);
+  DLSolver renumbered(interleaved.Rows());
+  EXPECT_EQ(AllSolutions(renumbered), AllSolutions(added));
+}
+
+TEST(TestDLSolver, MatrixFileMappedBack) {
+  SparseQueens queens(true);
+  auto path = ::testing::TempDir() + "queens.dlx";
+  ASSERT_TRUE(WriteMatrixFile(path, queens.Rows()));
+
+  auto mapped = MappedMatrix::Open(path);
+  ASSERT_TRUE(mapped);
+  EXPECT_EQ(mapped->Rows().Rows(), queens.n * queens.n);
+  EXPECT_EQ(mapped->Rows().Secondary(), 2 * (2 * queens.n - 1));
+
+  DLSolver from_file(mapped->Rows());
+  DLSolver from_memory(queens.Rows());
+  EXPECT_EQ(AllSolutions(from_file), AllSolutions(from_memory));
+  std::remove(path.c_str());
+}
+
+TEST(TestDLSolver, CorruptedMatrixFileRejected) {
+  SparseQueens queens(false);
+  queens.columns[5] = 1000;
+  auto path = ::testing::TempDir() + "corrupted.dlx";
+  ASSERT_TRUE(WriteMatrixFile(path, queens.Rows()));
+  EXPECT_FALSE(MappedMatrix::Open(path));
+
+  std::ofstream(path, std::ios::trunc) << "DLXMATR1";
+  EXPECT_FALSE(MappedMatrix::Open(path));
+  std::remove(path.c_str());
+  EXPECT_FALSE(MappedMatrix::Open(path));
+}
+
+TEST(TestDLSolver, ColoredRowsShareSecondaryColumn) {
+  // Knuth's example of Algorithm C: primary p q r, secondary x y.
+  enum { P, Q, R, X, Y };
+  BasicDLSolver<ColorPolicy> solver(5, 3, 2);
+  const unsigned A = 1, B = 2;
+  solver.Add(0, P), solver.Add(0, Q), solver.Add(0, X), solver.Add(0, Y, A);
+  solver.Add(1, P), solver.Add(1, R), solver.Add(1, X, A), solver.Add(1, Y);
+  solver.Add(2, P), solver.Add(2, X, B);
+  solver.Add(3, Q), solver.Add(3, X, A);
+  solver.Add(4, R), solver.Add(4, Y, B);
+
+  EXPECT_EQ(solver.Count(), 1u);
+  auto solution = solver.Solve();
+  std::sort(begin(solution), end(solution));
+  EXPECT_EQ(solution, (std::vector<int>{1, 3}));
+}
+
+// Rows of a random instance: primary columns and colors of secondary ones.
+struct ColoredRow {
+  std::vector<unsigned> primary;
+  std::vector<std::pair<unsigned, unsigned>> secondary;
+};
+
+uint64_t BruteForceColoredCount(const std::vector<ColoredRow> &rows,
+                                unsigned n_cols, unsigned n_secondary,
+                                unsigned required) {
+  uint64_t found = 0;
+  for (unsigned subset = 0; subset < (1u << rows.size()); subset++) {
+    if ((subset & required) != required) {
+      continue;
+    }
+    std::vector<unsigned> covered(n_cols, 0);
+    // color of every secondary column, 0 unused, -1 used without color.
+    std::vector<int> color(n_secondary, 0);
+    bool ok = true;
+    for (unsigned r = 0; r < rows.size() && ok; r++) {
+      if (!(subset & (1u << r))) {
+        continue;
+      }
+      for (unsigned c : rows[r].primary) {
+        ok = ok && ++covered[c] == 1;
+      }
+      for (auto [c, k] : rows[r].secondary) {
+        int want = k == 0 ? -1 : (int)k;
+        ok = ok && (color[c] == 0 || (want > 0 && color[c] == want));
+        color[c] = want;
+      }
+    }
+    ok = ok && std::count(begin(covered), end(covered), 1u) == (int)n_cols;
+    found += ok;
+  }
+  return found;
+}
+
+template <typename Policy>
+void ExpectColoredCounts(const std::vector<ColoredRow> &rows, unsigned n_cols,
+                         unsigned n_secondary) {
+  BasicDLSolver<Policy> solver(rows.size(), n_cols, n_secondary);
+  for (unsigned r = 0; r < rows.size(); r++) {
+    for (unsigned c : rows[r].primary) {
+      solver.Add(r, c);
+    }
+    for (auto [c, k] : rows[r].secondary) {
+      solver.Add(r, n_cols + c, k);
+    }
+  }
+  EXPECT_EQ(solver.Count(),
+            BruteForceColoredCount(rows, n_cols, n_secondary, 0));
+  EXPECT_EQ(solver.ParallelCount(3), solver.Count());
+
+  ASSERT_TRUE(solver.Assume(0));
+  EXPECT_EQ(solver.Count(),
+            BruteForceColoredCount(rows, n_cols, n_secondary, 1));
+  solver.Retract();
+  EXPECT_EQ(solver.Count(),
+            BruteForceColoredCount(rows, n_cols, n_secondary, 0));
+
+  solver.DeleteRow(0);
+  EXPECT_EQ(solver.Count(),
+            BruteForceColoredCount(rows, n_cols, n_secondary, 1));
+}
+
+TEST(TestDLSolver, ColoredCountMatchesBruteForce) {
+  const unsigned n_cols = 4, n_secondary = 3, n_rows = 12;
+  std::mt19937 rng(1);
+  for (unsigned instance = 0; instance < 50; instance++) {
+    std::vector<ColoredRow> rows(n_rows);
+    for (auto &row : rows) {
+      for (unsigned c = 0; c < n_cols; c++) {
+        if (rng() % 3 == 0) {
+          row.primary.push_back(c);
+        }
+      }
+      if (row.primary.empty()) {
+        row.primary.push_back(rng() % n_cols);
+      }
+      for (unsigned c = 0; c < n_secondary; c++) {
+        if (rng() % 2 == 0) {
+          row.secondary.emplace_back(c, rng() % 3);
+        }
+      }
+    }
+    ExpectColoredCounts<ColorPolicy>(rows, n_cols, n_secondary);
+    ExpectColoredCounts<BucketColorPolicy>(rows, n_cols, n_secondary);
+  }
+}
+
+TEST_F(TestDLSolverParallel, SameCountWhenBoundsAreOne) {
+  auto dl = LatinSquare<BasicDLSolver<MultiplicityPolicy>>();
+  EXPECT_EQ(dl->Count(), 576u);
+
+  auto solution = dl->Solve();
+  EXPECT_EQ(solution.size(), N * N);
+}
+
+TEST(TestDLSolver, BoundedColumnTakesRowsWithinBounds) {
+  BasicDLSolver<MultiplicityPolicy> solver(5, 1);
+  for (unsigned r = 0; r < 5; r++) {
+    solver.Add(r, 0);
+  }
+  solver.SetBounds(0, 2, 3);
+  // choose 2 or 3 of the 5 rows.
+  EXPECT_EQ(solver.Count(), 20u);
+  auto solution = solver.Solve();
+  EXPECT_GE(solution.size(), 2u);
+  EXPECT_LE(solution.size(), 3u);
+
+  solver.SetBounds(0, 0, 1);
+  EXPECT_EQ(solver.Count(), 6u);
+}
+
+TEST(TestDLSolver, DeletedRowsTakeRoomOfBoundedColumn) {
+  BasicDLSolver<MultiplicityPolicy> solver(4, 2);
+  for (unsigned r = 0; r < 3; r++) {
+    solver.Add(r, 0);
+  }
+  solver.Add(3, 1);
+  solver.SetBounds(0, 1, 2);
+  // 1 or 2 of the first 3 rows, and the last one.
+  EXPECT_EQ(solver.Count(), 6u);
+
+  solver.DeleteRow(0);
+  // none or one more.
+  EXPECT_EQ(solver.Count(), 3u);
+  solver.DeleteRow(1);
+  // the column is full, row 2 is left out.
+  EXPECT_EQ(solver.Count(), 1u);
+  EXPECT_EQ(solver.Solve(), std::vector<int>{3});
+  solver.DeleteRow(3);
+  EXPECT_EQ(solver.Count(), 1u);
+  EXPECT_TRUE(solver.Solve().empty());
+}
+
+uint64_t BruteForceBoundedCount(const std::vector<ColoredRow> &rows,
+                                const std::vector<unsigned> &lower,
+                                const std::vector<unsigned> &upper,
+                                unsigned n_secondary, unsigned required) {
+  uint64_t found = 0;
+  for (unsigned subset = 0; subset < (1u << rows.size()); subset++) {
+    if ((subset & required) != required) {
+      continue;
+    }
+    std::vector<unsigned> covered(lower.size(), 0);
+    std::vector<int> color(n_secondary, 0);
+    bool ok = true;
+    for (unsigned r = 0; r < rows.size() && ok; r++) {
+      if (!(subset & (1u << r))) {
+        continue;
+      }
+      for (unsigned c : rows[r].primary) {
+        covered[c]++;
+      }
+      for (auto [c, k] : rows[r].secondary) {
+        int want = k == 0 ? -1 : (int)k;
+        ok = ok && (color[c] == 0 || (want > 0 && color[c] == want));
+        color[c] = want;
+      }
+    }
+    for (unsigned c = 0; c < lower.size(); c++) {
+      ok = ok && lower[c] <= covered[c] && covered[c] <= upper[c];
+    }
+    found += ok;
+  }
+  return found;
+}
+
+TEST(TestDLSolver, BoundedCountMatchesBruteForce) {
+  const unsigned n_cols = 4, n_secondary = 2, n_rows = 12;
+  std::mt19937 rng(2);
+  for (unsigned instance = 0; instance < 50; instance++) {
+    std::vector<ColoredRow> rows(n_rows);
+    for (auto &row : rows) {
+      for (unsigned c = 0; c < n_cols; c++) {
+        if (rng() % 3 == 0) {
+          row.primary.push_back(c);
+        }
+      }
+      if (row.primary.empty()) {
+        row.primary.push_back(rng() % n_cols);
+      }
+      for (unsigned c = 0; c < n_secondary; c++) {
+        if (rng() % 3 == 0) {
+          row.secondary.emplace_back(c, rng() % 3);
+        }
+      }
+    }
+    std::vector<unsigned> lower(n_cols), upper(n_cols);
+    for (unsigned c = 0; c < n_cols; c++) {
+      lower[c] = (unsigned)(rng() % 3);
+      upper[c] = std::max(1u, lower[c] + (unsigned)(rng() % 3));
+    }
+
+    BasicDLSolver<MultiplicityColorPolicy> solver(n_rows, n_cols, n_secondary);
+    for (unsigned r = 0; r < n_rows; r++) {
+      for (unsigned c : rows[r].primary) {
+        solver.Add(r, c);
+      }
+      for (auto [c, k] : rows[r].secondary) {
+        solver.Add(r, n_cols + c, k);
+      }
+    }
+    for (unsigned c = 0; c < n_cols; c++) {
+      solver.SetBounds(c, lower[c], upper[c]);
+    }
+    EXPECT_EQ(solver.Count(),
+              BruteForceBoundedCount(rows, lower, upper, n_secondary, 0));
+
+    ASSERT_TRUE(solver.Assume(0));
+    EXPECT_EQ(solver.Count(),
+              BruteForceBoundedCount(rows, lower, upper, n_secondary, 1));
+    solver.Retract();
+    EXPECT_EQ(solver.Count(),
+              BruteForceBoundedCount(rows, lower, upper, n_secondary, 0));
+
+    solver.DeleteRow(0);
+    EXPECT_EQ(solver.Count(),
+              BruteForceBoundedCount(rows, lower, upper, n_secondary, 1));
+
+    // the deleted rows fit while some set of rows without lower bounds
+    // contains them.
+    std::vector<unsigned> none(n_cols, 0);
+    unsigned deleted = 1;
+    for (unsigned r = 1; r < n_rows; r++) {
+      unsigned with = deleted | (1u << r);
+      if (BruteForceBoundedCount(rows, none, upper, n_secondary, with) == 0) {
+        continue;
+      }
+      solver.DeleteRow(r);
+      deleted = with;
+      EXPECT_EQ(solver.Count(), BruteForceBoundedCount(rows, lower, upper,
+                                                       n_secondary, deleted));
+    }
+  }
+}
@@ -0,0 +1,563 @@
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "sudoku.h"
+
+using namespace sudoku;
+using DancingLinks::SearchStatus;
+
+namespace {
+
+// solvable by naked and hidden singles alone.
+const std::string SINGLES = "7.9....2..8...5...461.2..79..76...3.....94..."
+                            "1..8..4.........5.........4.34.6.1..";
+// needs search after propagation.
+const std::string HARD = "8..........36......7..9.2...5...7.......457....."
+                         "1...3...1....68..85...1..9....4..";
+
+// 16x16 puzzle with a unique solution.
+const std::string P16 =
+    "| 12 15 . 1 3 . . 14 . . . . . . 10 . . 3 . . . 13 . . 5 . 9 . . . . . "
+    "11 . . 7 . . . . 12 1 15 . 2 . . 5 9 . . . 4 . . . 8 . 10 . . . . 12 15 "
+    "5 16 . 7 . . 1 14 4 . . . 3 . 6 . . . 3 13 . 6 . . . 11 7 . . . . . 1 . "
+    "9 . . . . 6 . . . 5 . 14 10 . . . . . . . 3 . . . . . . . . . . . 12 14 "
+    "2 7 . 11 . . . . 6 . 4 . 13 . . . . 9 5 . 3 . 8 . 7 11 . . . . 10 . 16 "
+    ". . 13 9 14 . . . . 2 . . 11 . . . 8 10 . 15 . 6 . . 9 1 . . 9 4 . . 5 "
+    ". . . . . 6 . . . . . . 11 10 8 . . . . . . . . . 16 . . . . 6 . . . "
+    "15 . . 1 4 . 12 9 6 . . . 16 9 4 15 . 8 . . 14 . 5 11";
+
+// every row, column and box holds every number once.
+bool IsSolution(const SudokuBoard &board) {
+  unsigned side = board.GetSide(), box = 1;
+  while ((box + 1) * (box + 1) <= side) {
+    box++;
+  }
+  for (unsigned u = 0; u < side; u++) {
+    std::vector<bool> row(side), col(side), area(side);
+    for (unsigned k = 0; k < side; k++) {
+      int r = board.Get(u, k), c = board.Get(k, u);
+      int a = board.Get(u / box * box + k / box, u % box * box + k % box);
+      if (r < 0 || c < 0 || a < 0 || row[r] || col[c] || area[a]) {
+        return false;
+      }
+      row[r] = col[c] = area[a] = true;
+    }
+  }
+  return true;
+}
+
+// filled cells of the puzzle have the same numbers in the board.
+bool Extends(const SudokuBoard &board, const SudokuBoard &puzzle) {
+  for (unsigned r = 0; r < puzzle.GetSide(); r++) {
+    for (unsigned c = 0; c < puzzle.GetSide(); c++) {
+      if (puzzle.Get(r, c) >= 0 && board.Get(r, c) != puzzle.Get(r, c)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+TEST(TestSudokuPropagate, ContradictionWhenNumberGivenTwice) {
+  auto row = SudokuBoard::FromString("1.......1" + std::string(72, '.'));
+  EXPECT_FALSE(row.Propagate());
+
+  auto column = SudokuBoard::FromString("1" + std::string(71, '.') + "1" +
+                                        std::string(8, '.'));
+  EXPECT_FALSE(column.Propagate());
+
+  auto box = SudokuBoard::FromString("1.........1" + std::string(70, '.'));
+  EXPECT_FALSE(box.Propagate());
+}
+
+TEST(TestSudokuPropagate, ContradictionWhenCellHasNoCandidate) {
+  // 9 in column 8 leaves nothing for the last cell of the first row.
+  auto board = SudokuBoard::FromString("12345678." + std::string(18, '.') +
+                                       "........9" + std::string(45, '.'));
+  EXPECT_FALSE(board.Propagate());
+}
+
+TEST(TestSudokuPropagate, ContradictionWhenNumberHasNoPlace) {
+  // 1 in the first box leaves no place for it in the first row, whose empty
+  // cells still have candidates 2 and 3.
+  auto board = SudokuBoard::FromString("...456789" "1........" +
+                                       std::string(63, '.'));
+  EXPECT_FALSE(board.Propagate());
+}
+
+TEST(TestSudokuPropagate, HiddenSingleFilled) {
+  // 1 is excluded from the first row by boxes 0 and 1 and columns 6 and 7,
+  // so it goes to the last cell, which has every other number left too.
+  auto board = SudokuBoard::Empty(9);
+  board.Set(1, 0, 0);
+  board.Set(2, 3, 0);
+  board.Set(4, 6, 0);
+  board.Set(7, 7, 0);
+
+  ASSERT_TRUE(board.Propagate());
+  EXPECT_EQ(board.Get(0, 8), 0);
+  EXPECT_FALSE(board.IsComplete());
+}
+
+TEST(TestSudokuPropagate, SinglesPuzzleSolvedCompletely) {
+  auto puzzle = SudokuBoard::FromString(SINGLES);
+  auto board = puzzle;
+
+  ASSERT_TRUE(board.Propagate());
+  EXPECT_TRUE(board.IsComplete());
+  EXPECT_TRUE(IsSolution(board));
+  EXPECT_TRUE(Extends(board, puzzle));
+}
+
+TEST(TestSudokuPropagate, PuzzleNeedingSearchPartiallyFilled) {
+  auto puzzle = SudokuBoard::FromString(HARD);
+  auto board = puzzle;
+  ASSERT_TRUE(board.Propagate());
+  EXPECT_FALSE(board.IsComplete());
+  EXPECT_TRUE(Extends(board, puzzle));
+
+  // cells filled by propagation agree with the only solution.
+  auto solved = std::make_shared<SudokuBoard>(puzzle);
+  ASSERT_EQ(SudokuMapper(solved).Solve(), SearchStatus::Solved);
+  EXPECT_TRUE(IsSolution(*solved));
+  EXPECT_TRUE(Extends(*solved, board));
+}
+
+TEST(TestSudokuPropagate, NoAnswerWhenPropagationFindsContradiction) {
+  auto board = std::make_shared<SudokuBoard>(
+      SudokuBoard::FromString("1.......1" + std::string(72, '.')));
+  EXPECT_EQ(SudokuMapper(board).Solve(), SearchStatus::NoSolution);
+}
+
+namespace {
+
+// Copy of the empty board template with the rows of filled cells deleted.
+std::unique_ptr<DancingLinks::DLSolver>
+TemplateInstance(const SudokuBoard &b) {
+  unsigned side = b.GetSide();
+  auto ret = std::make_unique<DancingLinks::DLSolver>(
+      SudokuMapper::EmptyBoardTemplate(side));
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      if (b.Get(r, c) >= 0) {
+        ret->DeleteRow((r * side + c) * side + b.Get(r, c));
+      }
+    }
+  }
+  return ret;
+}
+
+// Matrix of the board built from scratch, rows added in the order of the
+// template.
+std::unique_ptr<DancingLinks::DLSolver> FreshInstance(const SudokuBoard &b) {
+  unsigned side = b.GetSide(), box = 1;
+  while ((box + 1) * (box + 1) <= side) {
+    box++;
+  }
+  auto ret = std::make_unique<DancingLinks::DLSolver>(side * side * side,
+                                                      4 * side * side);
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      for (unsigned n = 0; n < side; n++) {
+        unsigned row = (r * side + c) * side + n;
+        ret->Add(row, c * side + n);
+        ret->Add(row, side * side + r * side + n);
+        ret->Add(row, 2 * side * side + (r / box * box + c / box) * side + n);
+        ret->Add(row, 3 * side * side + r * side + c);
+      }
+    }
+  }
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      if (b.Get(r, c) >= 0) {
+        ret->DeleteRow((r * side + c) * side + b.Get(r, c));
+      }
+    }
+  }
+  return ret;
+}
+
+} // namespace
+
+TEST(TestSudokuMapper, TemplateCopiesSolvedLikeFreshMatrix) {
+  std::vector<SudokuBoard> boards{
+      SudokuBoard::Empty(4), SudokuBoard::FromString(SINGLES),
+      SudokuBoard::FromString(HARD), SudokuBoard::Empty(9)};
+  auto two_clues = SudokuBoard::Empty(4);
+  two_clues.Set(0, 0, 1);
+  two_clues.Set(3, 2, 0);
+  boards.push_back(two_clues);
+
+  // every board gets a new copy after the previous ones were searched.
+  for (auto &board : boards) {
+    auto copy = TemplateInstance(board);
+    auto fresh = FreshInstance(board);
+    EXPECT_EQ(copy->NodeCount(), fresh->NodeCount());
+    EXPECT_EQ(copy->Solve(), fresh->Solve());
+    EXPECT_EQ(copy->Count(1000), fresh->Count(1000));
+  }
+  EXPECT_EQ(TemplateInstance(boards[0])->Count(), 288u);
+  EXPECT_EQ(TemplateInstance(boards[2])->Count(), 1u);
+}
+
+TEST(TestSudokuMapper, TemplateFirstUsedFromManyThreads) {
+  // no other test uses templates of side 25.
+  constexpr unsigned SIDE = 25, THREADS = 8;
+  auto empty = SudokuBoard::Empty(SIDE);
+  auto expected = FreshInstance(empty)->Solve();
+  ASSERT_EQ(expected.size(), SIDE * SIDE);
+
+  std::vector<const DancingLinks::DLSolver *> templates(THREADS);
+  std::vector<std::vector<int>> solutions(THREADS);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < THREADS; t++) {
+    threads.emplace_back([&, t] {
+      templates[t] = &SudokuMapper::EmptyBoardTemplate(SIDE);
+      solutions[t] = TemplateInstance(empty)->Solve();
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (unsigned t = 0; t < THREADS; t++) {
+    EXPECT_EQ(templates[t], templates[0]);
+    EXPECT_EQ(solutions[t], expected);
+  }
+}
+
+TEST(TestSudokuMapper, FixedSolverSolvedLikeFreshMatrix) {
+  std::vector<SudokuBoard> boards{
+      SudokuBoard::FromString(SINGLES), SudokuBoard::FromString(HARD),
+      SudokuBoard::Empty(9), SudokuBoard::FromString(P16),
+      SudokuBoard::Empty(16)};
+  for (auto &board : boards) {
+    auto fixed = board.GetSide() == 9 ? FixedSudokuSolver<9>::Create(board)
+                                      : FixedSudokuSolver<16>::Create(board);
+    auto fresh = FreshInstance(board);
+    EXPECT_EQ(fixed->NodeCount(), fresh->NodeCount());
+    EXPECT_EQ(fixed->Solve(), fresh->Solve());
+    EXPECT_EQ(fixed->Count(1000), fresh->Count(1000));
+  }
+}
+
+TEST(TestSudokuMapper, DlInstanceOfSide9SolvesBoard) {
+  // side 9 goes through FixedSudokuSolver<9>.
+  for (auto &puzzle : {SINGLES, HARD}) {
+    auto board = std::make_shared<SudokuBoard>(SudokuBoard::FromString(puzzle));
+    auto given = *board;
+    SudokuMapper mapper(board);
+    auto solver = mapper.DlInstance();
+    EXPECT_EQ(solver->Count(), 1u);
+    mapper.RevMap(solver->Solve());
+    EXPECT_TRUE(IsSolution(*board));
+    EXPECT_TRUE(Extends(*board, given));
+  }
+}
+
+TEST(TestSudokuMapper, ResidualInstanceSolvedLikeTemplate) {
+  auto puzzle = SudokuBoard::FromString(P16);
+  ASSERT_EQ(puzzle.GetSide(), 16u);
+
+  // the puzzle, and with fewer clues so there are many solutions.
+  std::vector<SudokuBoard> boards{puzzle, SudokuBoard::Empty(16)};
+  for (unsigned r = 4; r < 16; r++) {
+    for (unsigned c = 0; c < 16; c++) {
+      if (puzzle.Get(r, c) >= 0) {
+        boards[1].Set(r, c, puzzle.Get(r, c));
+      }
+    }
+  }
+
+  for (auto &board : boards) {
+    auto residual = SudokuMapper(std::make_shared<SudokuBoard>(board))
+                        .DlInstance();
+    auto full = TemplateInstance(board);
+    EXPECT_EQ(residual->Solve(), full->Solve());
+    EXPECT_EQ(residual->Count(1000), full->Count(1000));
+  }
+  EXPECT_EQ(TemplateInstance(boards[0])->Count(), 1u);
+  EXPECT_GT(TemplateInstance(boards[1])->Count(1000), 1u);
+}
+
+TEST(TestSudokuMapper, ResidualInstanceEmptyWhenGivensConflict) {
+  auto board = std::make_shared<SudokuBoard>(SudokuBoard::Empty(16));
+  board->Set(0, 0, 3);
+  board->Set(0, 15, 3);
+
+  auto solver = SudokuMapper(board).DlInstance();
+  EXPECT_EQ(solver->Count(), 0u);
+  EXPECT_TRUE(solver->Solve().empty());
+}
+
+TEST(TestSudokuGenerator, EveryClueNeededForUniqueness) {
+  SudokuGenerator generator(9, 3);
+  auto generated = generator.Generate();
+  ASSERT_TRUE(generated);
+  auto &puzzle = *generated;
+  ASSERT_EQ(generator.AbortedChecks(), 0u);
+  EXPECT_EQ(TemplateInstance(puzzle)->Count(2), 1u);
+
+  std::vector<int> vals(81);
+  for (unsigned i = 0; i < 81; i++) {
+    vals[i] = puzzle.Get(i / 9, i % 9);
+  }
+  for (unsigned i = 0; i < 81; i++) {
+    if (vals[i] < 0) {
+      continue;
+    }
+    int clue = vals[i];
+    vals[i] = -1;
+    EXPECT_EQ(TemplateInstance(SudokuBoard::FromValues(9, vals))->Count(2), 2u)
+        << "clue " << i << " is not needed";
+    vals[i] = clue;
+  }
+}
+
+TEST(TestSudokuGenerator, UniqueWhenChecksGiveUp) {
+  SudokuGenerator generator(9, 3, 1);
+  auto puzzle = generator.Generate();
+  ASSERT_TRUE(puzzle);
+  EXPECT_GT(generator.AbortedChecks(), 0u);
+  EXPECT_EQ(TemplateInstance(*puzzle)->Count(2), 1u);
+}
+
+TEST(TestSudokuGenerator, SolvedBoardsComplete) {
+  for (unsigned side : {1u, 4u, 9u, 16u}) {
+    SudokuGenerator generator(side, 5);
+    auto solved = generator.Solved();
+    ASSERT_TRUE(solved) << "side " << side;
+    EXPECT_TRUE(IsSolution(*solved)) << "side " << side;
+    if (side > 1) {
+      // the board of side 1 is the only one.
+      EXPECT_NE(generator.Solved()->ToString(), solved->ToString())
+          << "side " << side;
+    }
+  }
+}
+
+namespace {
+
+// Board equivalent to the given one: randomly transposed, with bands, stacks,
+// rows within bands, columns within stacks and numbers permuted.
+SudokuBoard Scramble(const SudokuBoard &board, std::mt19937 &rng) {
+  unsigned side = board.GetSide(), box = 1;
+  while ((box + 1) * (box + 1) <= side) {
+    box++;
+  }
+  auto shuffled = [&](unsigned n) {
+    std::vector<unsigned> order(n);
+    std::iota(begin(order), end(order), 0u);
+    std::shuffle(begin(order), end(order), rng);
+    return order;
+  };
+  // new line i is old line lines[i], same for columns.
+  auto lines = [&]() {
+    std::vector<unsigned> ret;
+    for (unsigned band : shuffled(box)) {
+      for (unsigned r : shuffled(box)) {
+        ret.push_back(band * box + r);
+      }
+    }
+    return ret;
+  };
+  auto rows = lines(), cols = lines(), numbers = shuffled(side);
+  bool transposed = rng() % 2 != 0;
+
+  std::vector<int> vals;
+  for (unsigned r = 0; r < side; r++) {
+    for (unsigned c = 0; c < side; c++) {
+      int n = transposed ? board.Get(cols[c], rows[r])
+                         : board.Get(rows[r], cols[c]);
+      vals.push_back(n < 0 ? n : (int)numbers[n]);
+    }
+  }
+  return SudokuBoard::FromValues(side, vals);
+}
+
+std::string CanonicalForm(const SudokuBoard &board) {
+  auto symmetry = SudokuSymmetry::Canonicalize(board);
+  return symmetry ? symmetry->Apply(board).ToString() : "";
+}
+
+} // namespace
+
+TEST(TestSudokuSymmetry, ScrambledBoardsShareCanonicalForm) {
+  std::mt19937 rng(1);
+  for (const auto &puzzle : {HARD, SINGLES, P16}) {
+    auto board = SudokuBoard::FromString(puzzle);
+    auto canonical = CanonicalForm(board);
+    ASSERT_NE(canonical, "");
+    for (int i = 0; i < 10; i++) {
+      EXPECT_EQ(CanonicalForm(Scramble(board, rng)), canonical);
+    }
+  }
+  EXPECT_NE(CanonicalForm(SudokuBoard::FromString(HARD)),
+            CanonicalForm(SudokuBoard::FromString(SINGLES)));
+}
+
+TEST(TestSudokuSymmetry, InvertUndoesApply) {
+  std::mt19937 rng(2);
+  for (const auto &puzzle : {HARD, P16}) {
+    auto board = Scramble(SudokuBoard::FromString(puzzle), rng);
+    auto symmetry = SudokuSymmetry::Canonicalize(board);
+    ASSERT_TRUE(symmetry);
+    EXPECT_EQ(symmetry->Invert(symmetry->Apply(board)).ToString(),
+              board.ToString());
+  }
+}
+
+TEST(TestSudokuSolutionCache, HitFillsOnlyEmptyCells) {
+  SudokuSolutionCache cache(4);
+  auto first = std::make_shared<SudokuBoard>(SudokuBoard::FromString(HARD));
+  ASSERT_EQ(cache.Solve(first), SearchStatus::Solved);
+
+  std::mt19937 rng(3);
+  auto puzzle = Scramble(SudokuBoard::FromString(HARD), rng);
+  auto board = std::make_shared<SudokuBoard>(puzzle);
+  ASSERT_EQ(cache.Solve(board), SearchStatus::Solved);
+  EXPECT_EQ(cache.Hits(), 1u);
+  EXPECT_EQ(cache.Misses(), 1u);
+  EXPECT_TRUE(IsSolution(*board));
+  EXPECT_TRUE(Extends(*board, puzzle));
+}
+
+TEST(TestSudokuSolutionCache, AbortedSearchNotCached) {
+  SudokuSolutionCache cache(4);
+  DancingLinks::SearchLimits limits;
+  limits.max_nodes = 1;
+  auto solve = [&](const DancingLinks::SearchLimits &l) {
+    return cache.Solve(
+        std::make_shared<SudokuBoard>(SudokuBoard::FromString(HARD)), l);
+  };
+
+  ASSERT_EQ(solve(limits), SearchStatus::Aborted);
+  EXPECT_EQ(solve(limits), SearchStatus::Aborted);
+  EXPECT_EQ(cache.Hits(), 0u);
+  EXPECT_EQ(solve({}), SearchStatus::Solved);
+  EXPECT_EQ(cache.Hits(), 0u);
+  // the solution is cached, limits no longer matter.
+  EXPECT_EQ(solve(limits), SearchStatus::Solved);
+  EXPECT_EQ(cache.Hits(), 1u);
+}
+
+TEST(TestSudokuSolutionCache, BoardWithoutCanonicalFormNotCached) {
+  auto empty = SudokuBoard::Empty(9);
+  ASSERT_FALSE(SudokuSymmetry::Canonicalize(empty));
+
+  SudokuSolutionCache cache(4);
+  for (int i = 0; i < 2; i++) {
+    auto board = std::make_shared<SudokuBoard>(empty);
+    ASSERT_EQ(cache.Solve(board), SearchStatus::Solved);
+    EXPECT_TRUE(IsSolution(*board));
+  }
+  EXPECT_EQ(cache.Hits(), 0u);
+  EXPECT_EQ(cache.Misses(), 0u);
+}
+
+TEST(TestSudokuSolutionCache, LeastRecentlyUsedEvicted) {
+  SudokuSolutionCache cache(2);
+  auto solve = [&](const std::string &puzzle) {
+    cache.Solve(std::make_shared<SudokuBoard>(SudokuBoard::FromString(puzzle)));
+    return std::make_pair(cache.Hits(), cache.Misses());
+  };
+  using Counts = std::pair<uint64_t, uint64_t>;
+
+  solve(HARD);
+  solve(SINGLES);
+  EXPECT_EQ(solve(HARD), Counts(1, 2));
+  // SINGLES is used least recently, P16 takes its place.
+  EXPECT_EQ(solve(P16), Counts(1, 3));
+  EXPECT_EQ(solve(HARD), Counts(2, 3));
+  EXPECT_EQ(solve(P16), Counts(3, 3));
+  EXPECT_EQ(solve(SINGLES), Counts(3, 4));
+}
+
+TEST(TestSudokuBatch, OutputInInputOrderWithThreads) {
+  // distinct puzzles, more than the threads keep in flight, with lines
+  // which are skipped or not solved in between.
+  std::mt19937 rng(11);
+  auto hard = SudokuBoard::FromString(HARD);
+  std::string conflict = "11" + std::string(79, '.');
+  std::vector<std::string> puzzles;
+  std::string input;
+  for (unsigned i = 0; i < 300; i++) {
+    std::string line = i % 7 == 3   ? "not a board"
+                       : i % 7 == 5 ? conflict
+                                    : Scramble(hard, rng).ToString();
+    puzzles.push_back(line);
+    input += line + "\n";
+    if (i % 10 == 0) {
+      input += "# comment\n\n  \t\n";
+    }
+  }
+
+  SudokuBatch batch(2);
+  std::istringstream in(input);
+  std::ostringstream out;
+  auto latencies = batch.Run(in, out);
+
+  std::istringstream written(out.str());
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(written, line);) {
+    lines.push_back(line);
+  }
+  ASSERT_EQ(lines.size(), puzzles.size());
+  for (size_t i = 0; i < puzzles.size(); i++) {
+    EXPECT_EQ(lines[i], SudokuBatch(1).Solve(puzzles[i])) << "line " << i;
+  }
+  EXPECT_EQ(lines[3], "INVALID");
+  EXPECT_EQ(lines[5], "NO ANSWER");
+  auto solved = SudokuBoard::FromString(lines[0]);
+  EXPECT_TRUE(IsSolution(solved));
+  EXPECT_TRUE(Extends(solved, SudokuBoard::FromString(puzzles[0])));
+
+  EXPECT_EQ(latencies.size(), puzzles.size());
+  EXPECT_TRUE(std::is_sorted(begin(latencies), end(latencies)));
+}
+
+TEST(TestSudokuBatch, LinesOfUnsolvedPuzzles) {
+  SudokuBatch batch(1);
+  EXPECT_EQ(batch.Solve(""), "INVALID");
+  EXPECT_EQ(batch.Solve("12345"), "INVALID");
+  EXPECT_EQ(batch.Solve(std::string(80, '.')), "INVALID");
+  EXPECT_EQ(batch.Solve("11" + std::string(79, '.')), "NO ANSWER");
+  EXPECT_EQ(batch.Solve(SINGLES).size(), 81u);
+
+  SudokuBatch::Limits limits;
+  limits.nodes = 1;
+  EXPECT_EQ(SudokuBatch(1, limits).Solve(P16), "ABORTED");
+
+  EXPECT_FALSE(SudokuBatch::IsPuzzle(""));
+  EXPECT_FALSE(SudokuBatch::IsPuzzle(" \t\r"));
+  EXPECT_FALSE(SudokuBatch::IsPuzzle("  # comment"));
+  EXPECT_TRUE(SudokuBatch::IsPuzzle(" " + SINGLES));
+}
+
+TEST(TestSudokuBatch, PercentileOfFewSamples) {
+  EXPECT_EQ(SudokuBatch::Percentile({}, 0), 0);
+  EXPECT_EQ(SudokuBatch::Percentile({}, 50), 0);
+  EXPECT_EQ(SudokuBatch::Percentile({}, 100), 0);
+
+  for (double p : {0.0, 50.0, 99.0, 100.0}) {
+    EXPECT_EQ(SudokuBatch::Percentile({7}, p), 7);
+  }
+
+  std::vector<double> two{1, 3};
+  EXPECT_EQ(SudokuBatch::Percentile(two, 0), 1);
+  EXPECT_EQ(SudokuBatch::Percentile(two, 49), 1);
+  EXPECT_EQ(SudokuBatch::Percentile(two, 50), 3);
+  EXPECT_EQ(SudokuBatch::Percentile(two, 100), 3);
+  EXPECT_EQ(SudokuBatch::Percentile(two, -10), 1);
+  EXPECT_EQ(SudokuBatch::Percentile(two, 150), 3);
+}